@@ -0,0 +1,137 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+// Incremented by the replaced global operator new in main_benchmark.cpp.
+inline std::atomic<size_t> allocations{0};
+
+struct result_t {
+    std::string name;
+    double median_ms = 0;
+    double p99_ms = 0;
+    size_t allocs = 0;
+    // Throughput, reported when non-zero.
+    size_t bytes = 0;
+    size_t count = 0;
+    std::string unit;
+};
+
+struct options_t {
+    int warmup = 3;
+    int reps = 20;
+};
+
+// Runs `f` `warmup` times untimed, then `reps` times timed, and reports
+// median and p99 latency plus the allocations made by a single run.
+template <typename F>
+result_t run(const std::string &name, const options_t &opts, F &&f) {
+    for (int i = 0; i < opts.warmup; ++i) {
+        f();
+    }
+    result_t result;
+    result.name = name;
+    size_t before = allocations.load(std::memory_order_relaxed);
+    f();
+    result.allocs = allocations.load(std::memory_order_relaxed) - before;
+
+    std::vector<double> samples;
+    samples.reserve(opts.reps);
+    for (int i = 0; i < opts.reps; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(
+                std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    result.median_ms = samples[samples.size() / 2];
+    result.p99_ms = samples[std::min(samples.size() - 1,
+                                     samples.size() * 99 / 100)];
+    return result;
+}
+
+inline void print(std::ostream &os, const result_t &r) {
+    os << std::left << std::setw(24) << r.name << std::right << std::fixed
+       << std::setprecision(3) << " median " << std::setw(10) << r.median_ms
+       << " ms  p99 " << std::setw(10) << r.p99_ms << " ms  allocs "
+       << std::setw(8) << r.allocs;
+    if (r.bytes) {
+        os << "  " << std::setprecision(3)
+           << r.bytes / (r.median_ms * 1e6) << " GB/s";
+    }
+    if (r.count) {
+        os << "  " << std::setprecision(0) << r.count / (r.median_ms / 1e3)
+           << " " << r.unit << "/s";
+    }
+    os << std::endl;
+}
+
+// Machine-readable results: one "<name>\t<metric>\t<value>" line per metric.
+inline void save(const std::string &path, const std::vector<result_t> &rs) {
+    std::ofstream os(path);
+    if (!os.is_open()) {
+        throw std::runtime_error("Failed to write results: " + path);
+    }
+    os << std::setprecision(9);
+    for (const auto &r : rs) {
+        os << r.name << "\tmedian_ms\t" << r.median_ms << "\n";
+        os << r.name << "\tp99_ms\t" << r.p99_ms << "\n";
+        os << r.name << "\tallocs\t" << r.allocs << "\n";
+    }
+}
+
+// Compares median latencies against a file written by save(). Returns the
+// number of results slower than the baseline by more than `threshold`
+// (a fraction, 0.1 = 10%); throws if the baseline can not be read, so that
+// a missing file is not taken for a regression.
+inline int compare(const std::string &path, const std::vector<result_t> &rs,
+                   double threshold) {
+    std::ifstream is(path);
+    if (!is.is_open()) {
+        throw std::runtime_error("Failed to open baseline: " + path);
+    }
+    std::map<std::string, double> baseline;
+    std::string name, metric;
+    double value;
+    while (is >> name >> metric >> value) {
+        if (metric == "median_ms") {
+            baseline[std::move(name)] = value;
+        }
+    }
+    int regressions = 0;
+    for (const auto &r : rs) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            continue;
+        }
+        double change = r.median_ms / it->second - 1;
+        if (change > threshold) {
+            std::cout << "REGRESSION ";
+            ++regressions;
+        } else {
+            std::cout << "ok         ";
+        }
+        std::cout << std::left << std::setw(24) << r.name << std::right
+                  << std::showpos << std::fixed << std::setprecision(1)
+                  << change * 100 << "%" << std::noshowpos << std::endl;
+    }
+    return regressions;
+}
+
+} // namespace bench
+
+#endif
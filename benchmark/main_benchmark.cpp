@@ -0,0 +1,350 @@
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include <executor.hpp>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <prepared_expr.hpp>
+#include <profiled_expr.hpp>
+#include <serialize.hpp>
+
+void *operator new(size_t size) {
+    bench::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+volatile size_t sink;
+
+std::string read_file(const std::string &path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+}
+
+size_t count_nodes(json::ref_t node) {
+    size_t count = 1;
+    if (node->type == json::tree::Type::DICT ||
+        node->type == json::tree::Type::LIST) {
+        for (auto child : node->all()) {
+            count += count_nodes(child);
+        }
+    }
+    return count;
+}
+
+// Expression nodes one evaluation runs: all but string literals, which are
+// path keys, as instrumented by --profile.
+size_t count_nodes(expr::tree::Node &node) {
+    size_t count = node.ret_type == expr::RetType::STR ? 0 : 1;
+    node.for_each_child(
+            [&count](expr::tree::Node &child) { count += count_nodes(child); });
+    return count;
+}
+
+// Parses all of `text` as a number.
+template <typename T> bool parse_number(const std::string &text, T &out) {
+    const char *end = text.data() + text.size();
+    auto [stop, error] = std::from_chars(text.data(), end, out);
+    return error == std::errc() && stop == end;
+}
+
+// NDJSON input (a .ndjson file) holds one document per line.
+std::vector<json::json_t>
+parse_documents(const std::string &text, bool ndjson,
+                const json::options_t &options = {}) {
+    std::vector<json::json_t> documents;
+    if (!ndjson) {
+        std::istringstream is(text);
+        documents.push_back(json::parse(is, options));
+        return documents;
+    }
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        end = end == std::string::npos ? text.size() : end;
+        if (end > start) {
+            std::istringstream is(text.substr(start, end - start));
+            documents.push_back(json::parse(is, options));
+        }
+        start = end + 1;
+    }
+    return documents;
+}
+
+// Validates every document without building trees, returns how many were
+// valid.
+size_t validate_documents(const std::string &text, bool ndjson) {
+    if (!ndjson) {
+        return json::validate(text).has_value();
+    }
+    size_t valid = 0;
+    std::string_view rest(text);
+    while (!rest.empty()) {
+        size_t end = std::min(rest.find('\n'), rest.size());
+        if (end > 0) {
+            valid += json::validate(rest.substr(0, end)).has_value();
+        }
+        rest.remove_prefix(std::min(end + 1, rest.size()));
+    }
+    return valid;
+}
+
+// Worker counts for the executor phases: powers of two up to one per core.
+std::vector<size_t> thread_counts() {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < cores; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(cores);
+    return counts;
+}
+
+// Queries submitted to the executor per worker and repetition, so that a
+// phase takes about as long for every worker count when throughput scales
+// with the workers.
+constexpr size_t executor_queries = 4;
+
+void usage(const char *prog) {
+    std::cerr << "Usage: " << prog
+              << " [--json <file>] [--queries <dir>] [--warmup <n>]"
+                 " [--reps <n>] [--out <file>] [--baseline <file>]"
+                 " [--threshold <percent>]"
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string json_path = "test/big.json";
+    std::string queries_dir = "test/bench";
+    std::string out_path, baseline_path;
+    double threshold = 10;
+    bench::options_t opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        bool ok = true;
+        if (arg == "--json") {
+            json_path = value;
+        } else if (arg == "--queries") {
+            queries_dir = value;
+        } else if (arg == "--warmup") {
+            ok = parse_number(value, opts.warmup) && opts.warmup >= 0;
+        } else if (arg == "--reps") {
+            ok = parse_number(value, opts.reps) && opts.reps >= 1;
+        } else if (arg == "--out") {
+            out_path = value;
+        } else if (arg == "--baseline") {
+            baseline_path = value;
+        } else if (arg == "--threshold") {
+            ok = parse_number(value, threshold) && threshold >= 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<bench::result_t> results;
+    auto report = [&results](bench::result_t &&r) {
+        bench::print(std::cout, r);
+        results.push_back(std::move(r));
+    };
+
+    try {
+        std::string text = read_file(json_path);
+        auto read = bench::run("read", opts, [&] {
+            sink = read_file(json_path).size();
+        });
+        read.bytes = text.size();
+        report(std::move(read));
+
+        bool ndjson = json_path.ends_with(".ndjson");
+        auto documents = parse_documents(text, ndjson);
+        auto parse = bench::run("parse", opts, [&] {
+            sink = parse_documents(text, ndjson).size();
+        });
+        parse.bytes = text.size();
+        for (const auto &json : documents) {
+            parse.count += count_nodes(json.get());
+        }
+        parse.unit = "nodes";
+        report(std::move(parse));
+
+        // Parsed again with the schema learned from the first document.
+        json::schema_t schema = json::infer(documents.front().get());
+        json::options_t shaped;
+        shaped.schema = &schema;
+        auto parse_schema = bench::run("parse_schema", opts, [&] {
+            sink = parse_documents(text, ndjson, shaped).size();
+        });
+        parse_schema.bytes = text.size();
+        report(std::move(parse_schema));
+
+        auto validate = bench::run("validate", opts, [&] {
+            sink = validate_documents(text, ndjson);
+        });
+        validate.bytes = text.size();
+        report(std::move(validate));
+
+        auto serialize_all = [&documents] {
+            size_t size = 0;
+            for (const auto &json : documents) {
+                size += json->to_string().size();
+            }
+            return size;
+        };
+        size_t serialized = serialize_all();
+        auto serialize = bench::run("serialize", opts,
+                                    [&] { sink = serialize_all(); });
+        serialize.bytes = serialized;
+        report(std::move(serialize));
+
+        // Chunked over one thread per core, whatever the size.
+        auto serialize_parallel = bench::run("serialize_parallel", opts, [&] {
+            size_t size = 0;
+            for (const auto &json : documents) {
+                size += json::serialize::to_string(json.get(), {0, 0}).size();
+            }
+            sink = size;
+        });
+        serialize_parallel.bytes = serialized;
+        report(std::move(serialize_parallel));
+
+        std::vector<std::filesystem::path> queries;
+        for (const auto &entry :
+             std::filesystem::directory_iterator(queries_dir)) {
+            queries.push_back(entry.path());
+        }
+        std::sort(queries.begin(), queries.end());
+
+        for (const auto &path : queries) {
+            std::string name = path.filename().string();
+            std::string query = read_file(path.string());
+
+            report(bench::run(name + "/expr_parse", opts, [&] {
+                std::istringstream is(query);
+                sink = expr::parse(is)->ret_type == expr::RetType::INT;
+            }));
+
+            std::istringstream is(query);
+            expr::expr_t expr = expr::parse(is);
+            size_t nodes = count_nodes(*expr);
+            auto eval = bench::run(name + "/eval", opts, [&] {
+                for (const auto &json : documents) {
+                    if (expr->ret_type == expr::RetType::INT) {
+                        sink = expr->eval(json.get());
+                    } else {
+                        sink = expr->to_string(json.get()).size();
+                    }
+                }
+            });
+            eval.count = nodes * documents.size();
+            eval.unit = "nodes";
+            report(std::move(eval));
+
+            // The same query with per-step slot caches, which pay off when
+            // the documents share a shape.
+            std::istringstream prepared_is(query);
+            expr::Prepared prepared(expr::parse(prepared_is));
+            auto eval_prepared = bench::run(name + "/eval_prepared", opts, [&] {
+                for (const auto &json : documents) {
+                    if (prepared.ret_type() == expr::RetType::INT) {
+                        sink = prepared.eval(json.get());
+                    } else {
+                        sink = prepared.to_string(json.get()).size();
+                    }
+                }
+            });
+            eval_prepared.count = nodes * documents.size();
+            eval_prepared.unit = "nodes";
+            report(std::move(eval_prepared));
+
+            // The overhead of --profile, which measures one evaluation in
+            // 16 of every node.
+            std::istringstream profiled_is(query);
+            expr::Profiled profiled(expr::parse(profiled_is), 16);
+            auto eval_profiled = bench::run(name + "/eval_profiled", opts, [&] {
+                for (const auto &json : documents) {
+                    if (profiled.ret_type() == expr::RetType::INT) {
+                        sink = profiled.eval(json.get());
+                    } else {
+                        sink = profiled.to_string(json.get()).size();
+                    }
+                }
+            });
+            eval_profiled.count = nodes * documents.size();
+            eval_profiled.unit = "nodes";
+            report(std::move(eval_profiled));
+
+            // Throughput of concurrent queries on the first document, per
+            // number of worker threads.
+            for (size_t threads : thread_counts()) {
+                size_t queries = executor_queries * threads;
+                query::Executor executor(documents.front().get(), {threads});
+                auto concurrent = bench::run(
+                        name + "/executor_" + std::to_string(threads), opts,
+                        [&] {
+                            std::vector<std::future<query::result_t>> futures;
+                            futures.reserve(queries);
+                            for (size_t i = 0; i < queries; ++i) {
+                                futures.push_back(executor.submit(*expr));
+                            }
+                            for (auto &future : futures) {
+                                sink = future.get().value.size();
+                            }
+                        });
+                concurrent.count = nodes * queries;
+                concurrent.unit = "nodes";
+                report(std::move(concurrent));
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // I/O errors exit with 1, regressions with 2.
+    int regressions = 0;
+    try {
+        if (!out_path.empty()) {
+            bench::save(out_path, results);
+        }
+        if (!baseline_path.empty()) {
+            regressions = bench::compare(baseline_path, results,
+                                         threshold / 100);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,286 @@
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Deterministic generator of synthetic JSON corpora for parser_bench.
+// Every document only uses the subset of JSON the parser accepts
+// (non-negative integers, strings, dicts and lists).
+
+namespace {
+
+// splitmix64, so the output for a given seed does not depend on the
+// standard library's distributions.
+class rng {
+  public:
+    rng(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+    uint64_t below(uint64_t n) { return next() % n; }
+
+  private:
+    uint64_t state;
+};
+
+class writer {
+  public:
+    writer(std::ostream &os) : os(os) {}
+    writer &operator<<(const std::string &s) {
+        os << s;
+        written += s.size();
+        return *this;
+    }
+    writer &operator<<(char c) {
+        os << c;
+        ++written;
+        return *this;
+    }
+    writer &operator<<(uint64_t n) { return *this << std::to_string(n); }
+    size_t written = 0;
+
+  private:
+    std::ostream &os;
+};
+
+struct options_t {
+    std::string shape;
+    size_t size = 0;
+    uint64_t seed = 1;
+    size_t depth = 64;
+    std::string out;
+    std::string queries;
+};
+
+// Identifiers in expressions are letters only, so keys are too.
+std::string key(uint64_t n) {
+    std::string s = "k";
+    do {
+        s.push_back('a' + n % 26);
+        n /= 26;
+    } while (n);
+    return s;
+}
+
+std::string text(rng &r, size_t length, bool escapes) {
+    static const std::vector<std::string> escaped = {"\\\\", "\\n", "\\t",
+                                                     "\\/", "\\u00e9"};
+    std::string s;
+    while (s.size() < length) {
+        if (escapes && r.below(16) == 0) {
+            s += escaped[r.below(escaped.size())];
+        } else {
+            s.push_back('a' + r.below(26));
+        }
+    }
+    return s;
+}
+
+void record(writer &w, rng &r, uint64_t id) {
+    w << "{\"id\": " << id << ", \"v\": " << r.below(1000000)
+      << ", \"name\": \"" << text(r, 8 + r.below(16), false)
+      << "\", \"tags\": [";
+    for (uint64_t i = 0, n = 1 + r.below(5); i < n; ++i) {
+        w << (i ? ", " : "") << r.below(100);
+    }
+    w << "]}";
+}
+
+using queries_t = std::vector<std::pair<std::string, std::string>>;
+
+queries_t deep(writer &w, rng &r, const options_t &opts) {
+    w << "{\"a\": [";
+    for (size_t chain = 0; chain < 2 || w.written < opts.size; ++chain) {
+        w << (chain ? ",\n" : "");
+        for (size_t i = 0; i < opts.depth; ++i) {
+            w << "{\"k\": [";
+        }
+        w << r.below(1000);
+        for (size_t i = 0; i < opts.depth; ++i) {
+            w << "]}";
+        }
+    }
+    w << "]}\n";
+    std::string path = "a[1]";
+    for (size_t i = 0; i < opts.depth; ++i) {
+        path += ".k[0]";
+    }
+    return {{"path", path}, {"size", "size(a)"}};
+}
+
+queries_t wide(writer &w, rng &r, const options_t &opts) {
+    w << "{\"d\": {";
+    uint64_t n = 0;
+    for (; n < 16 || w.written < opts.size; ++n) {
+        w << (n ? ",\n" : "") << '"' << key(n) << "\": " << r.below(1000);
+    }
+    w << "}}\n";
+    return {{"first", "d." + key(0)},
+            {"last", "d." + key(n - 1)},
+            {"size", "size(d)"}};
+}
+
+queries_t strings(writer &w, rng &r, const options_t &opts) {
+    w << "{\"s\": [";
+    for (size_t i = 0; i < 2 || w.written < opts.size; ++i) {
+        w << (i ? ",\n" : "") << '"' << text(r, 64 + r.below(4096), true)
+          << '"';
+    }
+    w << "]}\n";
+    return {{"first", "s[0]"}, {"size", "size(s) + size(s[1])"}};
+}
+
+queries_t numbers(writer &w, rng &r, const options_t &opts) {
+    w << "{\"n\": [";
+    for (size_t row = 0; row < 3 || w.written < opts.size; ++row) {
+        w << (row ? ",\n" : "") << '[';
+        for (size_t i = 0; i < 1024; ++i) {
+            w << (i ? ", " : "") << r.below(1u << 31);
+        }
+        w << ']';
+    }
+    w << "]}\n";
+    return {{"min", "min(n[0]) + max(n[1])"}, {"size", "size(n)"}};
+}
+
+queries_t records(writer &w, rng &r, const options_t &opts) {
+    w << "{\"r\": [";
+    for (uint64_t id = 0; id < 2 || w.written < opts.size; ++id) {
+        w << (id ? ",\n" : "");
+        record(w, r, id);
+    }
+    w << "]}\n";
+    return {{"field", "min(r.v) + max(r.id)"},
+            {"index", "r[1].name"},
+            {"size", "size(r)"}};
+}
+
+queries_t ndjson(writer &w, rng &r, const options_t &opts) {
+    for (uint64_t id = 0; id < 2 || w.written < opts.size; ++id) {
+        record(w, r, id);
+        w << '\n';
+    }
+    return {{"field", "v + id"}, {"tags", "max(tags)"}};
+}
+
+// Parses all of `s` as a number.
+template <typename T> bool parse_number(const std::string &s, T &out) {
+    const char *end = s.data() + s.size();
+    auto [stop, error] = std::from_chars(s.data(), end, out);
+    return error == std::errc() && stop == end;
+}
+
+// A byte count with an optional K, M or G suffix.
+bool parse_size(const std::string &s, size_t &out) {
+    std::string digits = s;
+    size_t shift = 0;
+    switch (s.empty() ? 0 : std::toupper(s.back())) {
+    case 'K':
+        shift = 10;
+        break;
+    case 'M':
+        shift = 20;
+        break;
+    case 'G':
+        shift = 30;
+        break;
+    }
+    if (shift) {
+        digits.pop_back();
+    }
+    if (!parse_number(digits, out) || out > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    out <<= shift;
+    return true;
+}
+
+void usage(const char *prog) {
+    std::cerr << "Usage: " << prog
+              << " <deep|wide|strings|numbers|records|ndjson> <size>[K|M|G]"
+                 " [--seed <n>] [--depth <n>] [--out <file>]"
+                 " [--queries <dir>]"
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    options_t opts;
+    opts.shape = argv[1];
+    if (!parse_size(argv[2], opts.size)) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--seed") {
+            ok = parse_number(argv[i + 1], opts.seed);
+        } else if (arg == "--depth") {
+            ok = parse_number(argv[i + 1], opts.depth);
+        } else if (arg == "--out") {
+            opts.out = argv[i + 1];
+        } else if (arg == "--queries") {
+            opts.queries = argv[i + 1];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    using generator_t = queries_t (*)(writer &, rng &, const options_t &);
+    const std::vector<std::pair<std::string, generator_t>> shapes = {
+            {"deep", deep},       {"wide", wide},       {"strings", strings},
+            {"numbers", numbers}, {"records", records}, {"ndjson", ndjson},
+    };
+    generator_t generate = nullptr;
+    for (const auto &[name, g] : shapes) {
+        if (name == opts.shape) {
+            generate = g;
+        }
+    }
+    if (generate == nullptr) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!opts.out.empty()) {
+        file.open(opts.out, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file: " << opts.out << std::endl;
+            return 1;
+        }
+    }
+    writer w(opts.out.empty() ? std::cout : file);
+    rng r(opts.seed);
+    queries_t queries = generate(w, r, opts);
+
+    if (!opts.queries.empty()) {
+        std::filesystem::create_directories(opts.queries);
+        for (const auto &[name, query] : queries) {
+            std::ofstream(std::filesystem::path(opts.queries) /
+                          (opts.shape + "_" + name))
+                    << query << "\n";
+        }
+    }
+}
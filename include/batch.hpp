@@ -0,0 +1,51 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <expr_parser.hpp>
+#include <functional>
+#include <json_parser.hpp>
+#include <string>
+#include <vector>
+
+// Evaluating one expression against many files. A reader thread loads the
+// files ahead of the workers (through io_uring when the kernel allows it,
+// blocking reads otherwise) while a pool of workers parses and evaluates
+// them, so reading overlaps with parsing.
+namespace batch {
+
+struct options_t {
+    // Worker threads, 0 for one per core.
+    size_t threads = 0;
+    // Bytes of file contents read but not yet evaluated. A file larger
+    // than the limit is still read, once nothing else is in flight.
+    size_t max_in_flight = 256 << 20;
+    // Reads submitted at once through io_uring.
+    unsigned queue_depth = 32;
+    json::options_t parse;
+};
+
+struct result_t {
+    std::string file;
+    bool ok;
+    // The printed result, or the error message when !ok.
+    std::string value;
+};
+
+using callback_t = std::function<void(const result_t &)>;
+
+// The result as printed by the CLI: a number for int expressions, the JSON
+// value otherwise.
+std::string evaluate(const expr::tree::Node &expr, json::ref_t json);
+
+// Expands glob patterns and "@file" arguments, which name a file listing
+// one path per line. Other arguments are returned unchanged.
+std::vector<std::string> expand(const std::vector<std::string> &args);
+
+// Evaluates `expr` against every file. `callback` is called once per file,
+// in completion order, never concurrently. Returns whether all succeeded.
+bool run(const std::vector<std::string> &files, const expr::tree::Node &expr,
+         const options_t &options, const callback_t &callback);
+
+} // namespace batch
+
+#endif
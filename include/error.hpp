@@ -0,0 +1,144 @@
+#ifndef ERROR_HPP
+#define ERROR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Error values for the non-throwing API (json::try_parse, expr::try_parse,
+// json::tree::Node::try_at, expr::tree::Node::try_eval). An error is a code
+// plus the byte offset of the input where it happened. The message is only
+// built when asked for, and the throwing API throws that message.
+namespace error {
+
+enum class Code : uint8_t {
+    // Parsing, `offset` is the byte offset in the input.
+    UNEXPECTED_EOF,
+    EXPECTED_CHAR,
+    UNEXPECTED_CHAR,
+    JSON_EOF_EXPECTED,
+    EXPR_EOF_EXPECTED,
+    MAX_DEPTH,
+    MEMORY_BUDGET,
+    INTEGER_RANGE,
+    // Validation only (json::validate).
+    INVALID_ESCAPE,
+    INVALID_UTF8,
+    CONTROL_CHAR,
+    INVALID_NUMBER,
+    INVALID_LITERAL,
+    // JSON access, `detail` is the node type name or the missing key.
+    NOT_SUBSCRIPTABLE,
+    NO_KEYS,
+    KEY_NOT_FOUND,
+    INDEX_OUT_OF_RANGE,
+    NOT_INT,
+    // Evaluation, `detail` names the node or operator kind.
+    UNKNOWN_OPERATOR,
+    NO_SIZE,
+    UNKNOWN_FUNCTION,
+    STRING_LITERAL,
+    EMPTY_AGGREGATE,
+};
+
+struct error_t {
+    Code code;
+    // The expected character for EXPECTED_CHAR.
+    char expected = 0;
+    size_t offset = 0;
+    // Views a static string or the key passed to try_at; for a missing key
+    // it is only valid while that key is.
+    std::string_view detail = {};
+};
+
+template <typename T> using result_t = std::expected<T, error_t>;
+
+inline std::string message(const error_t &e) {
+    std::string detail(e.detail);
+    switch (e.code) {
+    case Code::UNEXPECTED_EOF:
+        return "PARSE: Unexpected EOF";
+    case Code::EXPECTED_CHAR:
+        return (std::string) "PARSE: Expected character " + e.expected;
+    case Code::UNEXPECTED_CHAR:
+        return "JSON_PARSE: Unexpected character when parsing value";
+    case Code::JSON_EOF_EXPECTED:
+        return "JSON_PARSE: EOF expected";
+    case Code::EXPR_EOF_EXPECTED:
+        return "EXPR_PARSE: EOF expected";
+    case Code::MAX_DEPTH:
+        return "JSON_PARSE: Maximum nesting depth exceeded";
+    case Code::MEMORY_BUDGET:
+        return "JSON_PARSE: Memory budget exceeded";
+    case Code::INTEGER_RANGE:
+        return "JSON_PARSE: Integer out of range";
+    case Code::INVALID_ESCAPE:
+        return "JSON_PARSE: Invalid escape sequence";
+    case Code::INVALID_UTF8:
+        return "JSON_PARSE: Invalid UTF-8";
+    case Code::CONTROL_CHAR:
+        return "JSON_PARSE: Unescaped control character in string";
+    case Code::INVALID_NUMBER:
+        return "JSON_PARSE: Invalid number";
+    case Code::INVALID_LITERAL:
+        return "JSON_PARSE: Invalid literal";
+    case Code::NOT_SUBSCRIPTABLE:
+        return "JSON: " + detail + " is not subscriptable";
+    case Code::NO_KEYS:
+        return "JSON: " + detail + " has no keys";
+    case Code::KEY_NOT_FOUND:
+        return "JSON: Key not found: " + detail;
+    case Code::INDEX_OUT_OF_RANGE:
+        return "JSON: List index out of range";
+    case Code::NOT_INT:
+        return "JSON: " + detail + " can not be converted to int";
+    case Code::UNKNOWN_OPERATOR:
+        return "EVAL: Unknown " + detail + " operator";
+    case Code::NO_SIZE:
+        return "EVAL: " + detail + " node has no size";
+    case Code::UNKNOWN_FUNCTION:
+        return "EVAL: Unknown intrinsic function";
+    case Code::STRING_LITERAL:
+        return "EVAL: Cannot evaluate string literal";
+    case Code::EMPTY_AGGREGATE:
+        return "EVAL: Aggregate over empty list";
+    }
+    return "Unknown error";
+}
+
+[[noreturn]] inline void raise(const error_t &e) {
+    throw std::runtime_error(message(e));
+}
+
+template <typename T> T value(result_t<T> &&result) {
+    if (!result) {
+        raise(result.error());
+    }
+    return *std::move(result);
+}
+
+struct position_t {
+    size_t line;
+    size_t column;
+};
+
+// 1-based line and column of a byte offset in `text`.
+inline position_t position(std::string_view text, size_t offset) {
+    position_t pos{1, 1};
+    for (size_t i = 0; i < offset && i < text.size(); ++i) {
+        if (text[i] == '\n') {
+            ++pos.line;
+            pos.column = 1;
+        } else {
+            ++pos.column;
+        }
+    }
+    return pos;
+}
+
+} // namespace error
+
+#endif
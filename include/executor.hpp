@@ -0,0 +1,61 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <expr_parser.hpp>
+#include <functional>
+#include <future>
+#include <json_parser.hpp>
+#include <memory>
+#include <string>
+
+// Serving many queries against one loaded document. An Executor owns a
+// fixed pool of worker threads that evaluate submitted expressions against
+// the shared document and hand back futures or call callbacks.
+//
+//     query::Executor executor(json.get());
+//     auto result = executor.submit(*expr);
+//     std::cout << result.get().value;
+//
+// Documents from json::parse may be read by several threads at once: list
+// columns are built under a lock, and evaluation keeps its temporaries in
+// per thread buffers (see expr::tree::scratch()). Sidecar documents decode
+// nodes on access and can not be shared.
+namespace query {
+
+struct options_t {
+    // Worker threads, 0 for one per core.
+    size_t threads = 0;
+};
+
+struct result_t {
+    bool ok;
+    // The result as printed by the CLI, or the error message when !ok.
+    std::string value;
+};
+
+using callback_t = std::function<void(const result_t &)>;
+
+class Executor {
+  public:
+    Executor(json::ref_t document, const options_t &options = {});
+    // Waits for the queries already submitted.
+    ~Executor();
+
+    // Evaluates `expr`, which must outlive the evaluation. Expressions are
+    // not changed by evaluation and may be submitted many times at once,
+    // except expr::Prepared ones, whose caches belong to one thread.
+    std::future<result_t> submit(const expr::tree::Node &expr);
+    // As submit(), calling `callback` on the worker thread instead. Calls
+    // may run concurrently and must not throw.
+    void submit(const expr::tree::Node &expr, callback_t callback);
+
+    size_t threads() const;
+
+  private:
+    struct state_t;
+    std::unique_ptr<state_t> state;
+};
+
+} // namespace query
+
+#endif
@@ -2,15 +2,33 @@
 #define EXPR_PARSER_HPP
 
 #include <algorithm>
+#include <climits>
+#include <error.hpp>
+#include <functional>
 #include <istream>
 #include <json_parser.hpp>
 #include <memory>
-#include <stdexcept>
+#include <stats.hpp>
 #include <string>
+#include <vector>
 
 namespace expr {
 
+// Values are doubles: integers above 2^53 in magnitude, from the document
+// or from arithmetic, lose their low bits.
 using eval_t = double;
+using result_t = error::result_t<eval_t>;
+
+// A computed list index as the int lists take, or INDEX_OUT_OF_RANGE for
+// values no int holds.
+inline error::result_t<int> to_index(eval_t value) {
+    if (!(value >= INT_MIN && value <= INT_MAX)) {
+        return std::unexpected(
+                error::error_t{error::Code::INDEX_OUT_OF_RANGE});
+    }
+    return static_cast<int>(value);
+}
+
 namespace tree {
 
 enum class RetType {
@@ -19,39 +37,76 @@ enum class RetType {
     JSON,
 };
 
+// Buffers for temporaries of evaluation, one set per thread and reused
+// across evaluations, so that evaluation stops allocating once they have
+// grown. They are only used by leaf computations, never across a nested
+// evaluation.
+struct scratch_t {
+    std::vector<json::ref_t> refs;
+    json::tree::column_t values;
+};
+
+inline scratch_t &scratch() {
+    thread_local scratch_t buffers;
+    return buffers;
+}
+
 class Node {
   public:
     Node(RetType type) : ret_type(type) {}
     virtual std::string to_string(json::ref_t json) const = 0;
-    virtual eval_t eval(json::ref_t json) const = 0;
-    virtual eval_t eval(json::ref_t json, const std::string &func) const {
+    eval_t eval(json::ref_t json) const {
+        return error::value(try_eval(json));
+    }
+    eval_t eval(json::ref_t json, const std::string &func) const {
+        return error::value(try_eval(json, func));
+    }
+    // As eval(), but returning the error instead of throwing it.
+    virtual result_t try_eval(json::ref_t json) const = 0;
+    virtual result_t try_eval(json::ref_t json,
+                              const std::string &func) const {
         if (func == "size") {
             return size(json);
         }
-        return eval(json);
+        return try_eval(json);
+    }
+    // Calls `visit` on every direct child node.
+    void for_each_child(const std::function<void(Node &)> &visit) {
+        for_each_slot([&visit](std::unique_ptr<Node> &child) {
+            visit(*child);
+        });
+    }
+    // Calls `visit` on the pointer owning every direct child, which it may
+    // replace, e.g. with a wrapper (see expr::Profiled).
+    virtual void
+    for_each_slot(const std::function<void(std::unique_ptr<Node> &)> &visit) {
     }
+    // The node without its children, e.g. "+" or "min()".
+    virtual std::string label() const = 0;
     virtual ~Node() = default;
     const RetType ret_type;
 
   protected:
-    virtual eval_t size(json::ref_t json) const = 0;
+    virtual result_t size(json::ref_t json) const = 0;
 };
 
 using ptr_t = std::unique_ptr<Node>;
 
 class IntNode : public Node {
   public:
-    IntNode(int value) : Node(RetType::INT), value(value) {}
+    IntNode(int64_t value) : Node(RetType::INT), value(value) {}
     std::string to_string(json::ref_t json) const override {
         return std::to_string(value);
     }
-    eval_t eval(json::ref_t json) const override { return value; }
+    result_t try_eval(json::ref_t json) const override { return value; }
+    using Node::try_eval;
+    std::string label() const override { return std::to_string(value); }
 
   protected:
-    eval_t size(json::ref_t json) const override { return 1; }
+    result_t size(json::ref_t json) const override { return 1; }
 
   private:
-    int value;
+    int64_t value;
 };
 
 class BinaryNode : public Node {
@@ -63,23 +118,39 @@ class BinaryNode : public Node {
         return "(" + left->to_string(json) + " " + op + " " +
                right->to_string(json) + ")";
     }
-    eval_t eval(json::ref_t json) const override {
+    result_t try_eval(json::ref_t json) const override {
+        auto l = left->try_eval(json);
+        if (!l) {
+            return l;
+        }
+        auto r = right->try_eval(json);
+        if (!r) {
+            return r;
+        }
         switch (op) {
         case '+':
-            return left->eval(json) + right->eval(json);
+            return *l + *r;
         case '-':
-            return left->eval(json) - right->eval(json);
+            return *l - *r;
         case '*':
-            return left->eval(json) * right->eval(json);
+            return *l * *r;
         case '/':
-            return left->eval(json) / right->eval(json);
+            return *l / *r;
         }
-        throw std::runtime_error("EVAL: Unknown binary operator");
+        return std::unexpected(
+                error::error_t{error::Code::UNKNOWN_OPERATOR, 0, 0, "binary"});
+    }
+    using Node::try_eval;
+    void for_each_slot(const std::function<void(ptr_t &)> &visit) override {
+        visit(left);
+        visit(right);
     }
+    std::string label() const override { return std::string(1, op); }
 
   protected:
-    eval_t size(json::ref_t json) const override {
-        throw std::runtime_error("EVAL: Binary node has no size");
+    result_t size(json::ref_t json) const override {
+        return std::unexpected(
+                error::error_t{error::Code::NO_SIZE, 0, 0, "Binary"});
     }
 
   private:
@@ -94,17 +165,28 @@ class UnaryNode : public Node {
     std::string to_string(json::ref_t json) const override {
         return (std::string) "(" + op + child->to_string(json) + ")";
     }
-    eval_t eval(json::ref_t json) const override {
+    result_t try_eval(json::ref_t json) const override {
+        auto value = child->try_eval(json);
+        if (!value) {
+            return value;
+        }
         switch (op) {
         case '-':
-            return -child->eval(json);
+            return -*value;
         }
-        throw std::runtime_error("EVAL: Unknown unary operator");
+        return std::unexpected(
+                error::error_t{error::Code::UNKNOWN_OPERATOR, 0, 0, "unary"});
+    }
+    using Node::try_eval;
+    void for_each_slot(const std::function<void(ptr_t &)> &visit) override {
+        visit(child);
     }
+    std::string label() const override { return std::string(1, op); }
 
   protected:
-    eval_t size(json::ref_t json) const override {
-        throw std::runtime_error("EVAL: Unary node has no size");
+    result_t size(json::ref_t json) const override {
+        return std::unexpected(
+                error::error_t{error::Code::NO_SIZE, 0, 0, "Unary"});
     }
 
   private:
@@ -129,103 +211,260 @@ class FunctionNode : public Node {
         result += ")";
         return result;
     }
-    eval_t eval(json::ref_t json) const override {
-        if (func == "size") {
-            eval_t result = 0;
-            for (const auto &arg : args) {
-                result += arg->eval(json, func);
-            }
-            return result;
+    result_t try_eval(json::ref_t json) const override {
+        bool size = func == "size";
+        if (!size && func != "min" && func != "max") {
+            return std::unexpected(
+                    error::error_t{error::Code::UNKNOWN_FUNCTION});
         }
-        std::vector<eval_t> values;
-        values.reserve(args.size());
-        if (func == "min") {
-            for (const auto &arg : args) {
-                values.push_back(arg->eval(json, func));
-            }
-            return *std::min_element(values.begin(), values.end());
+        if (!size && args.empty()) {
+            return std::unexpected(
+                    error::error_t{error::Code::EMPTY_AGGREGATE});
         }
-        if (func == "max") {
-            for (const auto &arg : args) {
-                values.push_back(arg->eval(json, func));
+        eval_t result = 0;
+        for (auto it = args.begin(); it != args.end(); ++it) {
+            auto value = (*it)->try_eval(json, func);
+            if (!value) {
+                return value;
+            }
+            if (size) {
+                result += *value;
+            } else if (it == args.begin() ||
+                       (func == "min" ? *value < result : *value > result)) {
+                result = *value;
             }
-            return *std::max_element(values.begin(), values.end());
         }
-        throw std::runtime_error("EVAL: Unknown intrinsic function");
+        return result;
     }
+    using Node::try_eval;
+    void for_each_slot(const std::function<void(ptr_t &)> &visit) override {
+        for (auto &arg : args) {
+            visit(arg);
+        }
+    }
+    std::string label() const override { return func + "()"; }
+    const std::string &name() const { return func; }
 
   protected:
-    eval_t size(json::ref_t json) const override { return args.size(); }
+    result_t size(json::ref_t json) const override { return args.size(); }
 
   private:
     std::string func;
     args_t args;
 };
 
+class StringLiteralNode : public Node {
+  public:
+    StringLiteralNode(std::string &&value)
+        : Node(RetType::STR), value(std::move(value)) {}
+    std::string to_string(json::ref_t json) const override { return value; }
+    const std::string &str() const { return value; }
+    std::string label() const override { return '"' + value + '"'; }
+    result_t try_eval(json::ref_t json) const override {
+        return std::unexpected(error::error_t{error::Code::STRING_LITERAL});
+    }
+    using Node::try_eval;
+
+  protected:
+    result_t size(json::ref_t json) const override { return value.size(); }
+
+  private:
+    std::string value;
+};
+
 class JsonNode : public Node {
   public:
     JsonNode(std::vector<ptr_t> &&indices)
         : Node(RetType::JSON), indices(std::move(indices)) {}
     std::string to_string(json::ref_t json) const override {
-        return get(json)->to_string();
+        return error::value(get(json))->to_string();
+    }
+    result_t try_eval(json::ref_t json) const override {
+        auto current = get(json);
+        if (!current) {
+            return std::unexpected(current.error());
+        }
+        return to_int(*current);
     }
-    eval_t eval(json::ref_t json) const override { return get(json)->to_int(); }
-    eval_t eval(json::ref_t json, const std::string &func) const override {
+    result_t try_eval(json::ref_t json,
+                      const std::string &func) const override {
         if (func == "size") {
             return size(json);
         }
-        auto current = get(json);
-        std::vector<int> vals;
-        for (const auto &child : current->all()) {
-            vals.push_back(child->to_int());
+        // Aggregates over homogeneous lists (or over one field of a list of
+        // dicts, e.g. min(a.b.c)) run over the list's cached int column.
+        auto parent = get(json, indices.size() - 1);
+        if (!parent) {
+            return std::unexpected(parent.error());
         }
-        if (func == "min") {
-            return *std::min_element(vals.begin(), vals.end());
+        const auto &last = indices.back();
+        if ((*parent)->type == json::tree::Type::LIST &&
+            last->ret_type == RetType::STR) {
+            if (auto column = (*parent)->column(literal(last))) {
+                return aggregate(*column, func);
+            }
         }
-        if (func == "max") {
-            return *std::max_element(vals.begin(), vals.end());
+        auto current = step(*parent, indices.size() - 1, json);
+        if (!current) {
+            return std::unexpected(current.error());
         }
-        throw std::runtime_error("EVAL: Unknown intrinsic function");
+        if ((*current)->type == json::tree::Type::LIST) {
+            if (auto column = (*current)->column()) {
+                return aggregate(*column, func);
+            }
+        }
+        // Dicts aggregate over their values, gathered in this thread's
+        // scratch buffers.
+        scratch_t &buffers = scratch();
+        buffers.refs.clear();
+        buffers.values.clear();
+        (*current)->collect(buffers.refs);
+        for (auto child : buffers.refs) {
+            auto value = to_int(child);
+            if (!value) {
+                return value;
+            }
+            buffers.values.push_back(*value);
+        }
+        return aggregate(buffers.values, func);
     }
-
-  protected:
-    eval_t size(json::ref_t json) const override { return get(json)->size(); }
-
-  private:
-    json::ref_t get(json::ref_t json) const {
-        auto current = json;
+    void for_each_slot(const std::function<void(ptr_t &)> &visit) override {
+        for (auto &index : indices) {
+            visit(index);
+        }
+    }
+    // The path, with computed indices shown by their label, e.g. a.b[+].
+    std::string label() const override {
+        std::string result;
         for (const auto &index : indices) {
-            switch (index->ret_type) {
-            case RetType::INT:
-                current = current->at(index->eval(json));
-                break;
-            case RetType::STR:
-                current = current->at(index->to_string(json));
-                break;
-            case RetType::JSON:
-                current = current->at(index->eval(json));
-                break;
+            if (index->ret_type == RetType::STR) {
+                if (!result.empty()) {
+                    result += '.';
+                }
+                result += literal(index);
+            } else {
+                result += '[';
+                result += index->label();
+                result += ']';
             }
         }
-        return current;
+        return result;
     }
-    std::vector<ptr_t> indices;
-};
+    // The value the path leads to.
+    error::result_t<json::ref_t> resolve(json::ref_t json) const {
+        return get(json);
+    }
+    // The path steps: string literals for keys, other nodes for indices.
+    const std::vector<ptr_t> &path() const { return indices; }
 
-class StringLiteralNode : public Node {
-  public:
-    StringLiteralNode(std::string &&value)
-        : Node(RetType::STR), value(std::move(value)) {}
-    std::string to_string(json::ref_t json) const override { return value; }
-    eval_t eval(json::ref_t json) const override {
-        throw std::runtime_error("EVAL: Cannot evaluate string literal");
+    // Per path step slot of the key in the last dict seen there.
+    struct cache_t {
+        std::vector<size_t> slots;
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    // Turns on the inline cache, see expr::Prepared. Evaluation then writes
+    // to the cache, so the node must not be evaluated concurrently.
+    const cache_t &prepare() {
+        cache = std::make_unique<cache_t>();
+        cache->slots.assign(indices.size(), json::tree::Node::npos);
+        return *cache;
     }
 
   protected:
-    eval_t size(json::ref_t json) const override { return value.size(); }
+    result_t size(json::ref_t json) const override {
+        auto current = get(json);
+        if (!current) {
+            return std::unexpected(current.error());
+        }
+        return (*current)->size();
+    }
 
   private:
-    std::string value;
+    using ref_result_t = error::result_t<json::ref_t>;
+
+    ref_result_t get(json::ref_t json) const {
+        return get(json, indices.size());
+    }
+    // Resolves the first `count` path steps.
+    ref_result_t get(json::ref_t json, size_t count) const {
+        ref_result_t current = json;
+        for (size_t i = 0; i < count && current; ++i) {
+            current = step(*current, i, json);
+        }
+        return current;
+    }
+    ref_result_t step(json::ref_t current, size_t i, json::ref_t json) const {
+        const auto &index = indices[i];
+        stats::lookup();
+        if (index->ret_type == RetType::STR) {
+            if (cache && current->type == json::tree::Type::DICT) {
+                return cached_at(current, i);
+            }
+            return current->try_at(literal(index));
+        }
+        auto value = index->try_eval(json);
+        if (!value) {
+            return std::unexpected(value.error());
+        }
+        auto at = to_index(*value);
+        if (!at) {
+            return std::unexpected(at.error());
+        }
+        return current->try_at(*at);
+    }
+    // Tries the slot the key was found at last time before looking it up.
+    ref_result_t cached_at(json::ref_t dict, size_t i) const {
+        const auto &key = literal(indices[i]);
+        size_t &slot = cache->slots[i];
+        if (auto value = dict->at_slot(slot, key)) {
+            ++cache->hits;
+            return value;
+        }
+        ++cache->misses;
+        slot = dict->slot(key);
+        if (slot == json::tree::Node::npos) {
+            return std::unexpected(
+                    error::error_t{error::Code::KEY_NOT_FOUND, 0, 0, key});
+        }
+        return dict->at_slot(slot, key);
+    }
+    // String indices are always literals; their value outlives the error
+    // that may view it.
+    static const std::string &literal(const ptr_t &index) {
+        return static_cast<const StringLiteralNode *>(index.get())->str();
+    }
+    static result_t to_int(json::ref_t node) {
+        if (node->type != json::tree::Type::INT) {
+            return std::unexpected(error::error_t{
+                    error::Code::NOT_INT, 0, 0,
+                    json::tree::type_name(node->type)});
+        }
+        return node->to_int();
+    }
+    static result_t aggregate(const json::tree::column_t &column,
+                              const std::string &func) {
+        if (column.empty()) {
+            return std::unexpected(
+                    error::error_t{error::Code::EMPTY_AGGREGATE});
+        }
+        int64_t result = column[0];
+        if (func == "min") {
+            for (int64_t value : column) {
+                result = value < result ? value : result;
+            }
+            return result;
+        }
+        if (func == "max") {
+            for (int64_t value : column) {
+                result = value > result ? value : result;
+            }
+            return result;
+        }
+        return std::unexpected(error::error_t{error::Code::UNKNOWN_FUNCTION});
+    }
+    std::vector<ptr_t> indices;
+    std::unique_ptr<cache_t> cache;
 };
 } // namespace tree
 
@@ -233,6 +472,8 @@ using expr_t = expr::tree::ptr_t;
 using RetType = expr::tree::RetType;
 
 expr_t parse(std::istream &is);
+// As parse(), but returning the first error instead of throwing it.
+error::result_t<expr_t> try_parse(std::istream &is);
 } // namespace expr
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <istream>
+#include <memory>
+
+// Transparent decompression of parser input. Compressed streams are
+// recognized by their magic bytes and decompressed on a separate thread,
+// which hands blocks to the reading side through a bounded queue, so
+// decompression and parsing run concurrently.
+namespace io {
+
+enum class Format { PLAIN, GZIP, ZSTD };
+
+// Peeks at the magic bytes without consuming them.
+Format detect(std::istream &is);
+
+struct options_t {
+    // Size of the decompressed blocks handed to the reader.
+    size_t block_size = 1 << 20;
+    // Blocks decompressed ahead of the reader.
+    size_t queue_depth = 4;
+};
+
+// A stream over the decompressed contents of `is`, or nullptr if `is` is
+// not compressed. `is` must outlive the returned stream and must not be
+// read by anyone else meanwhile. Corrupt input throws std::runtime_error
+// from the reading call. Throws if the format is recognized but support
+// for it was not compiled in.
+std::unique_ptr<std::istream> decompress(std::istream &is,
+                                         const options_t &options = {});
+
+} // namespace io
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef JSON_BIND_HPP
+#define JSON_BIND_HPP
+
+#include <concepts>
+#include <istream>
+#include <limits>
+#include <map>
+#include <parser.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Decoding straight into user types, without building a json::tree.
+// A struct is described once by specializing json::bind::fields:
+//
+//     struct point { int x, y; };
+//     template <> struct json::bind::fields<point> {
+//         static constexpr auto value =
+//                 std::make_tuple(JSON_FIELD(point, x), JSON_FIELD(point, y));
+//     };
+//
+//     point p;
+//     json::parse(is, p);
+//
+// Described structs, integers, strings, std::vector and string keyed
+// std::map/std::unordered_map of those can be decoded. Keys not in the field
+// list are skipped, missing fields keep their value.
+namespace json::bind {
+
+template <typename T> struct fields;
+
+template <typename T, typename M> struct field_t {
+    std::string_view name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr field_t<T, M> field(std::string_view name, M T::*member) {
+    return {name, member};
+}
+
+#define JSON_FIELD(type, name) ::json::bind::field(#name, &type::name)
+
+template <typename T>
+concept described = requires { fields<T>::value; };
+
+template <typename T> struct is_vector : std::false_type {};
+template <typename T> struct is_vector<std::vector<T>> : std::true_type {};
+
+template <typename T> struct is_map : std::false_type {};
+template <typename T>
+struct is_map<std::map<std::string, T>> : std::true_type {};
+template <typename T>
+struct is_map<std::unordered_map<std::string, T>> : std::true_type {};
+
+template <typename T>
+concept decodable =
+        described<T> || std::same_as<T, std::string> ||
+        (std::integral<T> && !std::same_as<T, bool>) || is_vector<T>::value ||
+        is_map<T>::value;
+
+class reader : public parser::Parser {
+  public:
+    reader(std::istream *is) : parser::Parser(is) {}
+
+    template <typename T> void read(T &out) {
+        if constexpr (described<T>) {
+            object(out);
+        } else if constexpr (std::same_as<T, std::string>) {
+            string(out);
+        } else if constexpr (std::integral<T>) {
+            if (!std::isdigit(next())) {
+                throw std::runtime_error("JSON_BIND: Expected number");
+            }
+            // Values that do not fit the field's type are rejected, not
+            // wrapped.
+            constexpr T max = std::numeric_limits<T>::max();
+            out = 0;
+            while (std::isdigit(next())) {
+                int digit = next() - '0';
+                if (out > (max - digit) / 10) {
+                    fail(error::Code::INTEGER_RANGE);
+                }
+                out = static_cast<T>(out * 10 + digit);
+                advance();
+            }
+        } else if constexpr (is_vector<T>::value) {
+            out.clear();
+            expect('[');
+            if (next() != ']') {
+                read(out.emplace_back());
+                while (next() == ',') {
+                    advance();
+                    read(out.emplace_back());
+                }
+            }
+            expect(']');
+        } else {
+            out.clear();
+            expect('{');
+            if (next() != '}') {
+                entry(out);
+                while (next() == ',') {
+                    advance();
+                    entry(out);
+                }
+            }
+            expect('}');
+        }
+    }
+
+    // Skips one value of any type, checking only that brackets match.
+    void skip() {
+        closers.clear();
+        do {
+            char c = next();
+            if (c == '{' || c == '[') {
+                closers.push_back(c == '{' ? '}' : ']');
+                advance();
+            } else if ((c == '}' || c == ']') && !closers.empty()) {
+                if (c != closers.back()) {
+                    fail(error::Code::EXPECTED_CHAR, closers.back());
+                }
+                closers.pop_back();
+                advance();
+            } else if ((c == ',' || c == ':') && !closers.empty()) {
+                advance();
+            } else if (c == '"') {
+                string(key);
+            } else if (std::isdigit(c)) {
+                while (std::isdigit(next())) {
+                    advance();
+                }
+            } else {
+                throw std::runtime_error(
+                        "JSON_BIND: Unexpected character when skipping value");
+            }
+        } while (!closers.empty());
+    }
+
+  private:
+    template <typename T> void object(T &out) {
+        expect('{');
+        if (next() != '}') {
+            member(out);
+            while (next() == ',') {
+                advance();
+                member(out);
+            }
+        }
+        expect('}');
+    }
+
+    // Matches the key against the field names, comparing lengths first, and
+    // decodes the value into the first matching member.
+    template <typename T> void member(T &out) {
+        string(key);
+        expect(':');
+        bool found = std::apply(
+                [&](const auto &...field) {
+                    return ((field.name.size() == key.size() &&
+                             field.name == key &&
+                             (read(out.*(field.member)), true)) ||
+                            ...);
+                },
+                fields<T>::value);
+        if (!found) {
+            skip();
+        }
+    }
+
+    template <typename M> void entry(M &out) {
+        std::string name;
+        string(name);
+        expect(':');
+        read(out[std::move(name)]);
+    }
+
+    void string(std::string &out) {
+        out.clear();
+        expect('"');
+        while (next() != '"') {
+            out.push_back(next());
+            advance();
+        }
+        expect('"');
+    }
+
+    // Reused for keys so matching a field does not allocate.
+    std::string key;
+    // Closing brackets of the containers skip() is in.
+    std::vector<char> closers;
+};
+
+} // namespace json::bind
+
+namespace json {
+
+template <typename T>
+    requires bind::decodable<T>
+void parse(std::istream &is, T &out) {
+    bind::reader reader(&is);
+    reader.read(out);
+    if (!reader.eof()) {
+        throw std::runtime_error("JSON_PARSE: EOF expected");
+    }
+}
+
+} // namespace json
+
+#endif
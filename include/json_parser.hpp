@@ -1,11 +1,19 @@
 #ifndef JSON_PARSER_HPP
 #define JSON_PARSER_HPP
 
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <error.hpp>
 #include <istream>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
+#include <stats.hpp>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -15,40 +23,105 @@ namespace tree {
 
 class Node;
 using ptr_t = std::unique_ptr<Node>;
-using dict_t = std::unordered_map<std::string, ptr_t>;
+// Dict entries in document order.
+using dict_t = std::vector<std::pair<std::string, ptr_t>>;
 using list_t = std::vector<ptr_t>;
 using ref_t = const Node *;
+using column_t = std::vector<int64_t>;
 
 enum class Type { INT, STRING, DICT, LIST };
 
+inline const char *type_name(Type type) {
+    switch (type) {
+    case Type::INT:
+        return "Int";
+    case Type::STRING:
+        return "String";
+    case Type::DICT:
+        return "Dict";
+    case Type::LIST:
+        return "List";
+    }
+    return "Unknown";
+}
+
+// Slots of a dict's keys. Dicts parsed with a schema share the schema's
+// index, which owns its keys; other dicts index their own keys.
+struct index_t {
+    std::vector<std::string> keys;
+    std::unordered_map<std::string_view, size_t> slots;
+};
+
+// Appends the text of `node`, as returned by its to_string(), to `out`.
+// Dicts and lists are walked without recursion; see serialize.hpp for
+// writing large values on several threads.
+void append(ref_t node, std::string &out);
+
 class Node {
   public:
     Node(Type type) : type(type) {}
     virtual std::string to_string() const = 0;
-    virtual int to_int() const = 0;
+    // Appends to_string() to `out`; leaves override it to skip the copy.
+    virtual void print(std::string &out) const { out += to_string(); }
+    virtual int64_t to_int() const = 0;
     virtual size_t size() const = 0;
-    virtual std::vector<ref_t> all() const { return {this}; }
-    virtual ref_t at(int index) const = 0;
-    virtual ref_t at(const std::string &key) const = 0;
+    // The values of a dict or list, or this node itself.
+    std::vector<ref_t> all() const {
+        std::vector<ref_t> refs;
+        collect(refs);
+        return refs;
+    }
+    // As all(), appending to `out` so that callers can reuse its storage.
+    virtual void collect(std::vector<ref_t> &out) const {
+        out.push_back(this);
+    }
+    ref_t at(int index) const { return error::value(try_at(index)); }
+    ref_t at(const std::string &key) const {
+        return error::value(try_at(key));
+    }
+    // As at(), but returning the error instead of throwing it.
+    virtual error::result_t<ref_t> try_at(int index) const {
+        return std::unexpected(error::error_t{
+                error::Code::NOT_SUBSCRIPTABLE, 0, 0, type_name(type)});
+    }
+    virtual error::result_t<ref_t> try_at(const std::string &key) const {
+        return std::unexpected(
+                error::error_t{error::Code::NO_KEYS, 0, 0, type_name(type)});
+    }
+
+    static constexpr size_t npos = -1;
+    // Position of `key` among a dict's entries, npos if it is missing or
+    // this is not a dict. Dicts of the same shape hold their keys at the
+    // same slots.
+    virtual size_t slot(std::string_view key) const { return npos; }
+    // The value at `slot` if that entry holds `key`, nullptr otherwise.
+    virtual ref_t at_slot(size_t slot, std::string_view key) const {
+        return nullptr;
+    }
+    // A list's elements, or field `key` of every element, as a contiguous
+    // int column; nullptr if they are not all ints or this is not a list.
+    virtual const column_t *column() const { return nullptr; }
+    virtual const column_t *column(const std::string &key) const {
+        return nullptr;
+    }
     virtual ~Node() = default;
     const Type type;
 };
 
 class IntNode : public Node {
   public:
-    IntNode(int value) : Node(Type::INT), value(value) {}
+    IntNode(int64_t value) : Node(Type::INT), value(value) {}
     std::string to_string() const override { return std::to_string(value); }
-    int to_int() const override { return value; }
-    size_t size() const override { return 1; }
-    ref_t at(int index) const override {
-        throw std::runtime_error("JSON: Int is not subscriptable");
-    }
-    ref_t at(const std::string &key) const override {
-        throw std::runtime_error("JSON: Int has no keys");
+    void print(std::string &out) const override {
+        char digits[24];
+        auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(digits, end);
     }
+    int64_t to_int() const override { return value; }
+    size_t size() const override { return 1; }
 
   private:
-    int value;
+    int64_t value;
 };
 
 class StringNode : public Node {
@@ -56,16 +129,11 @@ class StringNode : public Node {
     StringNode(std::string &&value)
         : Node(Type::STRING), value(std::move(value)) {}
     std::string to_string() const override { return value; }
-    int to_int() const override {
+    void print(std::string &out) const override { out += value; }
+    int64_t to_int() const override {
         throw std::runtime_error("JSON: String can not be converted to int");
     }
     size_t size() const override { return value.size(); }
-    ref_t at(int index) const override {
-        throw std::runtime_error("JSON: String is not subscriptable");
-    }
-    ref_t at(const std::string &key) const override {
-        throw std::runtime_error("JSON: String has no keys");
-    }
 
   private:
     std::string value;
@@ -73,91 +141,210 @@ class StringNode : public Node {
 
 class DictNode : public Node {
   public:
-    DictNode(dict_t &&dict) : Node(Type::DICT), dict(std::move(dict)) {}
-    std::string to_string() const override {
-        std::stringstream ss;
-        ss << "{";
-        bool first = true;
-        for (const auto &[key, value] : dict) {
-            if (!first) {
-                ss << ", ";
-            }
-            if (value->type == Type::STRING) {
-                ss << "\"" << key << "\": \"" << value->to_string() << "\"";
-            } else {
-                ss << "\"" << key << "\": " << value->to_string();
-            }
-            first = false;
+    // A repeated key keeps its first position and its last value.
+    DictNode(dict_t &&entries) : Node(Type::DICT), dict(std::move(entries)) {
+        if (!build_index()) {
+            std::erase_if(dict,
+                          [](const auto &entry) { return !entry.second; });
+            build_index();
         }
-        ss << "}";
-        return ss.str();
     }
-    int to_int() const override {
+    // Entries whose keys are exactly `shared->keys`, in order.
+    DictNode(dict_t &&entries, std::shared_ptr<const index_t> shared)
+        : Node(Type::DICT), dict(std::move(entries)),
+          index(std::move(shared)) {}
+    std::string to_string() const override {
+        std::string out;
+        append(this, out);
+        return out;
+    }
+    int64_t to_int() const override {
         throw std::runtime_error("JSON: Dict can not be converted to int");
     };
     size_t size() const override { return dict.size(); }
-    std::vector<ref_t> all() const override {
-        std::vector<ref_t> refs;
-        refs.reserve(dict.size());
+    const dict_t &entries() const { return dict; }
+    void collect(std::vector<ref_t> &out) const override {
+        out.reserve(out.size() + dict.size());
         for (const auto &[key, value] : dict) {
-            refs.push_back(value.get());
+            out.push_back(value.get());
         }
-        return refs;
     }
-    ref_t at(int index) const override {
-        throw std::runtime_error("JSON: Dict is not subscriptable");
+    error::result_t<ref_t> try_at(const std::string &key) const override {
+        if (auto value = find(key)) {
+            return value;
+        }
+        return std::unexpected(
+                error::error_t{error::Code::KEY_NOT_FOUND, 0, 0, key});
+    }
+    using Node::try_at;
+    ref_t find(std::string_view key) const {
+        size_t i = slot(key);
+        return i != npos ? dict[i].second.get() : nullptr;
     }
-    ref_t at(const std::string &key) const override {
-        auto it = dict.find(key);
-        if (it != dict.end()) {
-            return it->second.get();
+    size_t slot(std::string_view key) const override {
+        if (!index) {
+            for (size_t i = 0; i < dict.size(); ++i) {
+                if (dict[i].first == key) {
+                    stats::probes(i + 1);
+                    return i;
+                }
+            }
+            stats::probes(dict.size());
+            return npos;
+        }
+        stats::probes(1);
+        auto it = index->slots.find(key);
+        return it != index->slots.end() ? it->second : npos;
+    }
+
+    // Dicts up to this size are searched linearly and have no index.
+    static constexpr size_t linear_max = 8;
+    ref_t at_slot(size_t slot, std::string_view key) const override {
+        stats::probes(1);
+        if (slot < dict.size() && dict[slot].first == key) {
+            return dict[slot].second.get();
         }
-        throw std::runtime_error((std::string) "JSON: Key not found: " + key);
+        return nullptr;
     }
 
   private:
+    // Indexes the entries; on a repeated key moves its value to the first
+    // entry and returns false.
+    bool build_index() {
+        index = nullptr;
+        bool unique = true;
+        if (dict.size() <= linear_max) {
+            for (size_t i = 1; i < dict.size(); ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (dict[j].first == dict[i].first) {
+                        dict[j].second = std::move(dict[i].second);
+                        unique = false;
+                        break;
+                    }
+                }
+            }
+            return unique;
+        }
+        auto built = std::make_shared<index_t>();
+        built->slots.reserve(dict.size());
+        for (size_t i = 0; i < dict.size(); ++i) {
+            auto [it, inserted] = built->slots.emplace(dict[i].first, i);
+            if (!inserted) {
+                dict[it->second].second = std::move(dict[i].second);
+                unique = false;
+            }
+        }
+        index = std::move(built);
+        return unique;
+    }
+
     dict_t dict;
+    // Views the keys in `dict`, which is never resized after indexing, or
+    // those of a schema.
+    std::shared_ptr<const index_t> index;
 };
 
 class ListNode : public Node {
   public:
     ListNode(list_t &&list) : Node(Type::LIST), list(std::move(list)) {}
     std::string to_string() const override {
-        std::stringstream ss;
-        ss << "[";
-        for (auto it = list.begin(); it != list.end(); ++it) {
-            if (it != list.begin()) {
-                ss << ", ";
-            }
-            ss << (*it)->to_string();
-        }
-        ss << "]";
-        return ss.str();
+        std::string out;
+        append(this, out);
+        return out;
     }
-    int to_int() const override {
+    int64_t to_int() const override {
         throw std::runtime_error("JSON: List can not be converted to int");
     };
     size_t size() const override { return list.size(); }
-    std::vector<ref_t> all() const override {
-        std::vector<ref_t> refs;
-        refs.reserve(list.size());
-        for (size_t i = 0; i < list.size(); ++i) {
-            refs.push_back(list[i].get());
+    const list_t &elements() const { return list; }
+    void collect(std::vector<ref_t> &out) const override {
+        out.reserve(out.size() + list.size());
+        for (const auto &elem : list) {
+            out.push_back(elem.get());
         }
-        return refs;
     }
-    ref_t at(int index) const override {
+    error::result_t<ref_t> try_at(int index) const override {
         if (index >= 0 && (size_t)index < list.size()) {
             return list[index].get();
         }
-        throw std::runtime_error("JSON: List index out of range");
+        return std::unexpected(
+                error::error_t{error::Code::INDEX_OUT_OF_RANGE});
+    }
+    using Node::try_at;
+
+    // Columns are built on first use and cached with the list. Several
+    // threads may ask for them at once.
+    const column_t *column() const override {
+        columns_t &cache = this->cache();
+        std::call_once(cache.built, [this, &cache] {
+            cache.self =
+                    build_column([](ref_t elem) -> ref_t { return elem; });
+        });
+        return cache.self.get();
     }
-    ref_t at(const std::string &key) const override {
-        throw std::runtime_error("JSON: List is has no keys");
+    const column_t *column(const std::string &key) const override {
+        columns_t &cache = this->cache();
+        {
+            std::shared_lock lock(cache.mutex);
+            auto it = cache.fields.find(key);
+            if (it != cache.fields.end()) {
+                return it->second.get();
+            }
+        }
+        // Elements of the same shape hold the key at the same slot.
+        size_t slot = npos;
+        auto column = build_column([&key, &slot](ref_t elem) -> ref_t {
+            if (auto value = elem->at_slot(slot, key)) {
+                return value;
+            }
+            slot = elem->slot(key);
+            return elem->at_slot(slot, key);
+        });
+        // A column built meanwhile by another thread wins.
+        std::unique_lock lock(cache.mutex);
+        return cache.fields.try_emplace(key, std::move(column))
+                .first->second.get();
     }
+    ~ListNode() override { delete columns.load(std::memory_order_acquire); }
 
   private:
+    struct columns_t {
+        std::once_flag built;
+        std::unique_ptr<column_t> self;
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<column_t>> fields;
+    };
+
+    // Lists that are never aggregated over pay one pointer for the cache.
+    columns_t &cache() const {
+        columns_t *cache = columns.load(std::memory_order_acquire);
+        if (cache) {
+            return *cache;
+        }
+        auto created = std::make_unique<columns_t>();
+        if (columns.compare_exchange_strong(cache, created.get(),
+                                            std::memory_order_acq_rel)) {
+            return *created.release();
+        }
+        return *cache;
+    }
+
+    template <typename F>
+    std::unique_ptr<column_t> build_column(F &&project) const {
+        auto column = std::make_unique<column_t>();
+        column->reserve(list.size());
+        for (const auto &elem : list) {
+            ref_t value = project(elem.get());
+            if (value == nullptr || value->type != Type::INT) {
+                return nullptr;
+            }
+            column->push_back(value->to_int());
+        }
+        return column;
+    }
+
     list_t list;
+    mutable std::atomic<columns_t *> columns = nullptr;
 };
 
 } // namespace tree
@@ -165,7 +352,66 @@ class ListNode : public Node {
 using json_t = tree::ptr_t;
 using ref_t = tree::ref_t;
 
+// The expected shape of documents, see options_t::schema.
+struct schema_t {
+    tree::Type type = tree::Type::INT;
+    // Dicts: keys in the order they appear in.
+    std::vector<std::string> keys;
+    // Dicts: the shape of the value under each key. Lists: the shape of the
+    // elements, if known.
+    std::vector<schema_t> values;
+    // Lists: expected number of elements; the parser reserves at most 64.
+    size_t size = 0;
+    // Dicts with more than DictNode::linear_max keys: the index shared by
+    // every dict parsed with exactly these keys in this order. Set by
+    // compile().
+    std::shared_ptr<const tree::index_t> index;
+};
+
+// Appends a decimal digit to `value`, returning false instead if the
+// result would not fit in an int64_t.
+constexpr bool push_digit(int64_t &value, char digit) {
+    int64_t d = digit - '0';
+    if (value > (INT64_MAX - d) / 10) {
+        return false;
+    }
+    value = value * 10 + d;
+    return true;
+}
+
+// Learns the schema of `sample`. The elements of a list are assumed to be
+// shaped like its first one.
+schema_t infer(ref_t sample);
+// Builds the shared indices of a schema written by hand; infer() returns
+// compiled schemas.
+void compile(schema_t &schema);
+
+struct options_t {
+    // Maximum nesting of dicts and lists.
+    size_t max_depth = 1024;
+    // Maximum estimated bytes held by the parsed tree, 0 for no limit.
+    size_t max_bytes = 0;
+    // Parses documents expected to have this shape faster: the next key of
+    // a dict is compared against the expected one as it is read and dicts
+    // and lists are sized up front. Values of another shape are parsed the
+    // generic way. Must outlive parsing.
+    const schema_t *schema = nullptr;
+};
+
 json_t parse(std::istream &is);
+json_t parse(std::istream &is, const options_t &options);
+// As parse(), but returning the first error instead of throwing it. The
+// error offset is the byte offset in the stream, see error::position().
+error::result_t<json_t> try_parse(std::istream &is,
+                                  const options_t &options = {});
+
+// Checks that `text` is one well-formed JSON document (RFC 8259, a superset
+// of what parse() accepts: also floats, true/false/null and escapes) and
+// valid UTF-8, without building a tree or allocating. Only
+// options.max_depth applies. The error offset is the byte offset of the
+// first error in `text`.
+error::result_t<void> validate(std::string_view text,
+                               const options_t &options = {});
 } // namespace json
 
 #endif
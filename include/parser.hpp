@@ -1,42 +1,73 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <error.hpp>
 #include <istream>
-#include <stdexcept>
 #include <string>
 
 namespace parser {
 class Parser {
   public:
-    Parser(std::istream *is) : is_(is) { advance(); };
+    // A parser with `throws` unset records the first error instead of
+    // throwing it, see fail().
+    Parser(std::istream *is, bool throws = true) : is_(is), throws_(throws) {
+        advance();
+    };
     char next() {
         if (next_ == '\0') {
-            throw std::runtime_error("PARSE: Unexpected EOF");
+            fail(error::Code::UNEXPECTED_EOF);
         }
         return next_;
     }
     bool eof() { return next_ == '\0'; }
     void expect(char c) {
         if (next_ != c) {
-            throw std::runtime_error(
-                    (std::string) "PARSE: Expected character " + c);
+            fail(error::Code::EXPECTED_CHAR, c);
+            return;
         }
         advance();
     }
     void advance() {
+        if (failed_) {
+            return;
+        }
         do {
             if (is_->get(next_).eof()) {
                 next_ = '\0';
                 return;
             }
+            ++consumed_;
         } while (std::isspace(next_));
     }
+    size_t consumed() const { return consumed_; }
+    bool failed() const { return failed_; }
+    const error::error_t &error() const { return error_; }
 
     virtual ~Parser() = default;
 
+  protected:
+    // Throws the error, or records it and stops at a fake EOF, so that
+    // callers unwind without checking after every step.
+    void fail(error::Code code, char expected = 0) {
+        size_t offset = consumed_ - (next_ != '\0' ? 1 : 0);
+        error::error_t e{code, expected, offset};
+        if (throws_) {
+            error::raise(e);
+        }
+        if (!failed_) {
+            error_ = e;
+            failed_ = true;
+        }
+        next_ = '\0';
+    }
+
   private:
     std::istream *is_;
     char next_;
+    size_t consumed_ = 0;
+    bool throws_;
+    bool failed_ = false;
+    error::error_t error_{};
 };
 } // namespace parser
 #endif
@@ -0,0 +1,67 @@
+#ifndef PREPARED_EXPR_HPP
+#define PREPARED_EXPR_HPP
+
+#include <cstddef>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <string>
+#include <vector>
+
+// Expressions prepared for evaluation against many documents of the same
+// shape, e.g. the records of an NDJSON stream. Every dict lookup on a path
+// remembers the slot its key was found at and tries that slot first on the
+// next document, so on uniform records a lookup is a key compare instead of
+// a hash lookup. A mismatch falls back to the lookup and updates the slot.
+//
+//     expr::Prepared query(expr::parse(is));
+//     for (const auto &record : records) {
+//         query.eval(record.get());
+//     }
+//
+// Evaluation updates the caches, so one Prepared must not be evaluated from
+// several threads at once.
+namespace expr {
+
+class Prepared {
+  public:
+    explicit Prepared(expr_t &&expr) : expr(std::move(expr)) {
+        prepare(*this->expr);
+    }
+    eval_t eval(json::ref_t json) const { return expr->eval(json); }
+    result_t try_eval(json::ref_t json) const { return expr->try_eval(json); }
+    std::string to_string(json::ref_t json) const {
+        return expr->to_string(json);
+    }
+    const tree::Node &node() const { return *expr; }
+    RetType ret_type() const { return expr->ret_type; }
+
+    struct counters_t {
+        // Lookups answered by the remembered slot.
+        size_t hits = 0;
+        // Lookups that had to search the dict.
+        size_t misses = 0;
+    };
+    counters_t counters() const {
+        counters_t result;
+        for (auto cache : caches) {
+            result.hits += cache->hits;
+            result.misses += cache->misses;
+        }
+        return result;
+    }
+
+  private:
+    void prepare(tree::Node &node) {
+        if (node.ret_type == RetType::JSON) {
+            caches.push_back(&static_cast<tree::JsonNode &>(node).prepare());
+        }
+        node.for_each_child([this](tree::Node &child) { prepare(child); });
+    }
+
+    expr_t expr;
+    std::vector<const tree::JsonNode::cache_t *> caches;
+};
+
+} // namespace expr
+
+#endif
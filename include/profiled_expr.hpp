@@ -0,0 +1,76 @@
+#ifndef PROFILED_EXPR_HPP
+#define PROFILED_EXPR_HPP
+
+#include <cstddef>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Expressions instrumented to show which part of them is slow. Every node
+// that evaluates (all but string literals) is wrapped in one that counts
+// its evaluations and measures what they cost: wall time, path steps taken,
+// dict keys probed and heap allocations. The last three come from the
+// thread's stats counters, so they are zero unless built with STATS=1, and
+// allocations also need an operator new that reports them, as the CLI's
+// does. Costs are inclusive: a node's include those of its children.
+//
+//     expr::Profiled query(expr::parse(is), 16);
+//     for (const auto &record : records) {
+//         query.eval(record.get());
+//     }
+//     query.explain(std::cerr);
+//
+// With a sample period above one, each node measures only one evaluation
+// in that many and the report scales the measurements up. Counters are
+// atomic, so a Profiled may be evaluated from several threads at once.
+//
+// The wrappers hide the node types, so the root is no longer a JsonNode.
+namespace expr {
+
+class Profiled {
+  public:
+    explicit Profiled(expr_t &&expr, size_t sample = 1);
+    ~Profiled();
+    eval_t eval(json::ref_t json) const { return expr->eval(json); }
+    result_t try_eval(json::ref_t json) const { return expr->try_eval(json); }
+    std::string to_string(json::ref_t json) const {
+        return expr->to_string(json);
+    }
+    const tree::Node &node() const { return *expr; }
+    RetType ret_type() const { return expr->ret_type; }
+
+    struct counters_t {
+        size_t evals = 0;
+        // The rest are estimated from the measured evaluations.
+        double ms = 0;
+        size_t lookups = 0;
+        size_t probes = 0;
+        size_t allocations = 0;
+    };
+    struct entry_t {
+        std::string label;
+        // Of the node in the expression tree, 0 for the root.
+        size_t depth;
+        counters_t counters;
+    };
+    // One entry per instrumented node, in depth-first order.
+    std::vector<entry_t> report() const;
+    // Prints the report as a table, children indented under their parent.
+    void explain(std::ostream &os) const;
+
+    struct record_t;
+
+  private:
+    void instrument(tree::ptr_t &node, size_t depth);
+
+    expr_t expr;
+    size_t sample;
+    std::vector<std::unique_ptr<record_t>> records;
+};
+
+} // namespace expr
+
+#endif
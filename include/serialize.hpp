@@ -0,0 +1,37 @@
+#ifndef SERIALIZE_HPP
+#define SERIALIZE_HPP
+
+#include <json_parser.hpp>
+#include <ostream>
+#include <string>
+
+// Writing large values on several threads. The output size of every child
+// of a large dict or list is estimated, consecutive children are grouped
+// into chunks of about equal size, and the chunks are serialized into
+// separate buffers by a pool of threads and written out in order. Children
+// larger than a chunk are split the same way, so one huge list nested in a
+// dict is still spread over all threads. The text is the same as
+// Node::to_string().
+namespace json::serialize {
+
+struct options_t {
+    // Worker threads, 0 for one per core.
+    size_t threads = 0;
+    // Values estimated below this many bytes are written by the calling
+    // thread alone.
+    size_t min_parallel = 1 << 20;
+};
+
+// Length of node->to_string(): exact for parsed documents, a guess for
+// nodes decoded on access such as sidecar documents.
+size_t estimate(ref_t node);
+
+std::string to_string(ref_t node, const options_t &options = {});
+
+// Writes each chunk as soon as it and all chunks before it are done, so
+// writing overlaps with serializing.
+void write(std::ostream &os, ref_t node, const options_t &options = {});
+
+} // namespace json::serialize
+
+#endif
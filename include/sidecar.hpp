@@ -0,0 +1,58 @@
+#ifndef SIDECAR_HPP
+#define SIDECAR_HPP
+
+#include <json_parser.hpp>
+#include <memory>
+#include <string>
+
+// Persistent structural index for querying files without parsing them.
+// build() scans a file once and writes "<file>.idx" next to it, holding the
+// byte range of every value and, for every dict and list, where its keys and
+// elements are. open() maps the file and its index and returns a document
+// whose nodes are decoded from the mapped bytes when first reached, so a
+// query only touches the parts of the file its paths lead to and documents
+// larger than memory can be queried.
+//
+//     auto doc = json::sidecar::load("big.json");
+//     expr->eval(doc->root());
+//
+// An index is stale once the file's size, modification time or a hash of
+// its first and last 64 KiB change. Index files use the byte order of the
+// machine that built them.
+namespace json::sidecar {
+
+// Where the index of `path` is stored.
+std::string index_path(const std::string &path);
+
+// Scans `path` and writes its index. The index is written as the scan
+// goes, with scratch files next to it for large containers, so memory
+// depends on the nesting depth and on the number of keys of the dicts open
+// at once, which are held to find repeated keys, and not on the size of
+// the file. Syntax
+// errors throw std::runtime_error with the messages of json::parse; only
+// options.max_depth applies.
+void build(const std::string &path, const options_t &options = {});
+
+// A mapped file and its index. Nodes are created on first access and owned
+// by the document, so a document must not be queried from several threads
+// at once.
+class Document {
+  public:
+    // The root of the document for one query. Nodes are kept until the next
+    // call, which releases them, so memory is bounded by what one query
+    // reaches; refs from an earlier call must not be used after it.
+    virtual ref_t root() const = 0;
+    virtual ~Document() = default;
+};
+
+// Maps `path` and its index, or returns nullptr if the index is missing or
+// stale.
+std::unique_ptr<Document> open(const std::string &path);
+
+// As open(), building the index first if it is missing or stale.
+std::unique_ptr<Document> load(const std::string &path,
+                               const options_t &options = {});
+
+} // namespace json::sidecar
+
+#endif
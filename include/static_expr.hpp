@@ -0,0 +1,452 @@
+#ifndef STATIC_EXPR_HPP
+#define STATIC_EXPR_HPP
+
+#include <cstddef>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Expressions fixed at build time. The expression text is a template
+// argument, parsed by a constexpr version of expr::parse, and evaluation is
+// generated per node, so there is no runtime parse and no virtual dispatch:
+//
+//     using query = expr::fixed::expression<"max(a.b[3]) + 1">;
+//     query::eval(json.get());
+//
+// Syntax errors, unknown functions and size() of arithmetic are compile
+// errors. Evaluation errors on the document throw like expr::tree does.
+namespace expr::fixed {
+
+template <size_t N> struct fixed_string {
+    constexpr fixed_string(const char (&s)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            value[i] = s[i];
+        }
+    }
+    char value[N] = {};
+};
+
+enum class Kind { INT, NEG, BINARY, FUNC, JSON };
+enum class Func { SIZE, MIN, MAX };
+
+struct node_t {
+    Kind kind = Kind::INT;
+    char op = 0;
+    Func func = Func::SIZE;
+    int64_t value = 0;
+    // First of `count` operands or arguments in ast_t::args, or path steps in
+    // ast_t::steps, chained through their `next` fields. Nested expressions
+    // are parsed in between, so the lists are not contiguous.
+    size_t first = 0;
+    size_t count = 0;
+};
+
+struct arg_t {
+    size_t node = 0;
+    size_t next = 0;
+};
+
+// A path step is either a key (chars [begin, begin + length) of
+// ast_t::chars) or the node computing a list index.
+struct step_t {
+    bool key = false;
+    size_t begin = 0;
+    size_t length = 0;
+    size_t index = 0;
+    size_t next = 0;
+};
+
+template <size_t N> struct ast_t {
+    // The k-th operand, argument or step of a list starting at `first`.
+    constexpr size_t arg(size_t first, size_t k) const {
+        for (; k > 0; --k) {
+            first = args[first].next;
+        }
+        return args[first].node;
+    }
+    constexpr size_t step(size_t first, size_t k) const {
+        for (; k > 0; --k) {
+            first = steps[first].next;
+        }
+        return first;
+    }
+
+    node_t nodes[N] = {};
+    arg_t args[N] = {};
+    step_t steps[N] = {};
+    char chars[N] = {};
+    size_t node_count = 0;
+    size_t arg_count = 0;
+    size_t step_count = 0;
+    size_t char_count = 0;
+    size_t root = 0;
+};
+
+// Mirrors expr::expr_parser, building an ast_t instead of expr::tree nodes.
+template <size_t N> class parser_t {
+  public:
+    constexpr parser_t(const char *src) : src(src) { skip(); }
+
+    constexpr ast_t<N> parse() {
+        ast.root = add();
+        if (!eof()) {
+            throw std::runtime_error("EXPR_PARSE: EOF expected");
+        }
+        return ast;
+    }
+
+  private:
+    constexpr bool eof() const { return pos + 1 >= N || src[pos] == '\0'; }
+    constexpr char next() const {
+        if (eof()) {
+            throw std::runtime_error("PARSE: Unexpected EOF");
+        }
+        return src[pos];
+    }
+    constexpr void skip() {
+        while (!eof() && is_space(src[pos])) {
+            ++pos;
+        }
+    }
+    constexpr void advance() {
+        ++pos;
+        skip();
+    }
+    constexpr void expect(char c) {
+        if (next() != c) {
+            throw std::runtime_error("PARSE: Expected character");
+        }
+        advance();
+    }
+    static constexpr bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+               c == '\f';
+    }
+    static constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static constexpr bool is_alpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    constexpr size_t make(node_t node) {
+        ast.nodes[ast.node_count] = node;
+        return ast.node_count++;
+    }
+    constexpr size_t make(Kind kind, char op, size_t a, size_t b) {
+        node_t node{kind, op};
+        push_arg(node, a);
+        if (kind == Kind::BINARY) {
+            push_arg(node, b);
+        }
+        return make(node);
+    }
+    // Appends to the argument list of `node`, whose last entry is `last`.
+    constexpr void push_arg(node_t &node, size_t arg, size_t &last) {
+        ast.args[ast.arg_count] = {arg, 0};
+        if (node.count++ == 0) {
+            node.first = ast.arg_count;
+        } else {
+            ast.args[last].next = ast.arg_count;
+        }
+        last = ast.arg_count++;
+    }
+    constexpr void push_arg(node_t &node, size_t arg) {
+        size_t last = ast.arg_count - 1;
+        push_arg(node, arg, last);
+    }
+    constexpr void push_step(node_t &node, step_t step, size_t &last) {
+        ast.steps[ast.step_count] = step;
+        if (node.count++ == 0) {
+            node.first = ast.step_count;
+        } else {
+            ast.steps[last].next = ast.step_count;
+        }
+        last = ast.step_count++;
+    }
+
+    constexpr size_t term() {
+        size_t x = 0;
+        if (next() == '(') {
+            advance();
+            x = add();
+            expect(')');
+        } else if (is_digit(next())) {
+            x = number();
+        } else if (next() == '-') {
+            advance();
+            x = make(Kind::NEG, '-', term(), 0);
+        } else {
+            step_t ident = identifier();
+            if (!eof() && next() == '(') {
+                x = func(ident);
+            } else {
+                x = json_val(ident);
+            }
+        }
+        return x;
+    }
+
+    constexpr size_t add() {
+        size_t x = mul();
+        while (!eof() && (next() == '+' || next() == '-')) {
+            char op = next();
+            advance();
+            size_t y = mul();
+            x = make(Kind::BINARY, op, x, y);
+        }
+        return x;
+    }
+
+    constexpr size_t mul() {
+        size_t x = term();
+        while (!eof() && (next() == '*' || next() == '/')) {
+            char op = next();
+            advance();
+            size_t y = term();
+            x = make(Kind::BINARY, op, x, y);
+        }
+        return x;
+    }
+
+    constexpr size_t number() {
+        int64_t n = 0;
+        while (!eof() && is_digit(next())) {
+            if (!json::push_digit(n, next())) {
+                throw std::runtime_error("JSON_PARSE: Integer out of range");
+            }
+            advance();
+        }
+        return make({Kind::INT, 0, Func::SIZE, n, 0, 0});
+    }
+
+    constexpr size_t func(step_t ident) {
+        node_t node{Kind::FUNC};
+        if (name_is(ident, "size")) {
+            node.func = Func::SIZE;
+        } else if (name_is(ident, "min")) {
+            node.func = Func::MIN;
+        } else if (name_is(ident, "max")) {
+            node.func = Func::MAX;
+        } else {
+            throw std::runtime_error("EVAL: Unknown intrinsic function");
+        }
+        expect('(');
+        size_t last = 0;
+        if (next() != ')') {
+            push_arg(node, add(), last);
+            while (next() == ',') {
+                advance();
+                push_arg(node, add(), last);
+            }
+        }
+        expect(')');
+        if (node.func != Func::SIZE && node.count == 0) {
+            throw std::runtime_error("EVAL: Aggregate over empty list");
+        }
+        return make(node);
+    }
+
+    constexpr size_t json_val(step_t ident) {
+        node_t node{Kind::JSON};
+        size_t last = 0;
+        push_step(node, ident, last);
+        while (!eof() && (next() == '.' || next() == '[')) {
+            if (next() == '.') {
+                advance();
+                push_step(node, identifier(), last);
+            } else {
+                advance();
+                push_step(node, {false, 0, 0, add()}, last);
+                expect(']');
+            }
+        }
+        return make(node);
+    }
+
+    constexpr step_t identifier() {
+        step_t step{true, ast.char_count};
+        while (!eof() && is_alpha(next())) {
+            ast.chars[ast.char_count++] = next();
+            advance();
+        }
+        step.length = ast.char_count - step.begin;
+        if (step.length == 0) {
+            throw std::runtime_error("EXPR_PARSE: Identifier expected");
+        }
+        return step;
+    }
+
+    constexpr bool name_is(step_t ident, const char *name) const {
+        size_t i = 0;
+        for (; name[i] != '\0'; ++i) {
+            if (i >= ident.length || ast.chars[ident.begin + i] != name[i]) {
+                return false;
+            }
+        }
+        return i == ident.length;
+    }
+
+    const char *src;
+    size_t pos = 0;
+    ast_t<N> ast;
+};
+
+template <fixed_string S> class expression {
+  public:
+    static constexpr auto ast =
+            parser_t<sizeof(S.value)>(S.value).parse();
+    static constexpr RetType ret_type = ast.nodes[ast.root].kind == Kind::JSON
+                                                ? RetType::JSON
+                                                : RetType::INT;
+
+    static eval_t eval(json::ref_t json) { return eval_node<ast.root>(json); }
+    static std::string to_string(json::ref_t json)
+        requires(ret_type == RetType::JSON)
+    {
+        return get<ast.root>(json)->to_string();
+    }
+
+  private:
+    template <size_t I> static eval_t eval_node(json::ref_t json) {
+        constexpr node_t node = ast.nodes[I];
+        if constexpr (node.kind == Kind::INT) {
+            return node.value;
+        } else if constexpr (node.kind == Kind::NEG) {
+            return -eval_node<ast.arg(node.first, 0)>(json);
+        } else if constexpr (node.kind == Kind::BINARY) {
+            eval_t left = eval_node<ast.arg(node.first, 0)>(json);
+            eval_t right = eval_node<ast.arg(node.first, 1)>(json);
+            if constexpr (node.op == '+') {
+                return left + right;
+            } else if constexpr (node.op == '-') {
+                return left - right;
+            } else if constexpr (node.op == '*') {
+                return left * right;
+            } else {
+                return left / right;
+            }
+        } else if constexpr (node.kind == Kind::FUNC) {
+            return eval_func<I>(json, std::make_index_sequence<node.count>());
+        } else {
+            return get<I>(json)->to_int();
+        }
+    }
+
+    template <size_t I, size_t... A>
+    static eval_t eval_func(json::ref_t json, std::index_sequence<A...>) {
+        constexpr node_t node = ast.nodes[I];
+        if constexpr (node.func == Func::SIZE) {
+            return (eval_t(0) + ... +
+                    eval_arg<ast.arg(node.first, A), node.func>(json));
+        } else {
+            eval_t values[] = {
+                    eval_arg<ast.arg(node.first, A), node.func>(json)...};
+            eval_t result = values[0];
+            for (eval_t value : values) {
+                result = pick<node.func>(result, value);
+            }
+            return result;
+        }
+    }
+
+    // Node::eval(json, func) of the node at I.
+    template <size_t I, Func F> static eval_t eval_arg(json::ref_t json) {
+        constexpr node_t node = ast.nodes[I];
+        if constexpr (F != Func::SIZE) {
+            if constexpr (node.kind == Kind::JSON) {
+                return aggregate<I, F>(json);
+            } else {
+                return eval_node<I>(json);
+            }
+        } else if constexpr (node.kind == Kind::INT) {
+            return 1;
+        } else if constexpr (node.kind == Kind::FUNC) {
+            return node.count;
+        } else if constexpr (node.kind == Kind::JSON) {
+            return get<I>(json)->size();
+        } else {
+            static_assert(node.kind == Kind::INT,
+                          "EVAL: Arithmetic node has no size");
+        }
+    }
+
+    // min/max over the list a path refers to, with the same column fast
+    // paths as tree::JsonNode.
+    template <size_t I, Func F> static eval_t aggregate(json::ref_t json) {
+        constexpr node_t node = ast.nodes[I];
+        constexpr size_t last = ast.step(node.first, node.count - 1);
+        json::ref_t parent =
+                walk<I>(json, std::make_index_sequence<node.count - 1>());
+        if constexpr (ast.steps[last].key) {
+            if (parent->type == json::tree::Type::LIST) {
+                if (auto column = parent->column(key<last>)) {
+                    return fold<F>(*column);
+                }
+            }
+        }
+        json::ref_t current = step<last>(parent, json);
+        if (current->type == json::tree::Type::LIST) {
+            if (auto column = current->column()) {
+                return fold<F>(*column);
+            }
+        }
+        auto children = current->all();
+        if (children.empty()) {
+            throw std::runtime_error("EVAL: Aggregate over empty list");
+        }
+        int64_t result = children[0]->to_int();
+        for (auto child : children) {
+            result = pick<F>(result, child->to_int());
+        }
+        return result;
+    }
+
+    template <Func F> static eval_t fold(const json::tree::column_t &column) {
+        if (column.empty()) {
+            throw std::runtime_error("EVAL: Aggregate over empty list");
+        }
+        int64_t result = column[0];
+        for (int64_t value : column) {
+            result = pick<F>(result, value);
+        }
+        return result;
+    }
+
+    template <Func F, typename T> static T pick(T a, T b) {
+        if constexpr (F == Func::MIN) {
+            return b < a ? b : a;
+        } else {
+            return b > a ? b : a;
+        }
+    }
+
+    template <size_t I> static json::ref_t get(json::ref_t json) {
+        return walk<I>(json, std::make_index_sequence<ast.nodes[I].count>());
+    }
+
+    template <size_t I, size_t... P>
+    static json::ref_t walk(json::ref_t json, std::index_sequence<P...>) {
+        json::ref_t current = json;
+        ((current = step<ast.step(ast.nodes[I].first, P)>(current, json)), ...);
+        return current;
+    }
+
+    template <size_t P>
+    static json::ref_t step(json::ref_t current, json::ref_t json) {
+        if constexpr (ast.steps[P].key) {
+            return current->at(key<P>);
+        } else {
+            return current->at(error::value(
+                    to_index(eval_node<ast.steps[P].index>(json))));
+        }
+    }
+
+    template <size_t P>
+    static inline const std::string key{ast.chars + ast.steps[P].begin,
+                                        ast.steps[P].length};
+};
+
+} // namespace expr::fixed
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstddef>
+
+// Parse and evaluation statistics. Recording is compiled out unless
+// JSON_STATS is defined (make STATS=1, the default of make test and make
+// bench), in which case the counters of the calling thread are updated by
+// json::parse, expr::parse and the phases timed with stats::timer.
+namespace stats {
+
+#ifdef JSON_STATS
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+enum class Phase { READ, PARSE, EXPR_PARSE, EVAL, OUTPUT };
+inline constexpr size_t phase_count = 5;
+inline constexpr size_t type_count = 4;
+
+struct stats_t {
+    size_t bytes_consumed = 0;
+    // Indexed by json::tree::Type.
+    size_t nodes[type_count] = {};
+    // Estimated heap bytes held by the created nodes.
+    size_t bytes_allocated = 0;
+    size_t max_depth = 0;
+    // Path steps taken by expressions.
+    size_t lookups = 0;
+    // Dict keys compared or hashed to find a key.
+    size_t probes = 0;
+    // Heap allocations, when operator new reports them (the CLI's does).
+    size_t allocations = 0;
+    // Indexed by Phase.
+    double phase_ms[phase_count] = {};
+};
+
+inline stats_t &current() {
+    static thread_local stats_t stats;
+    return stats;
+}
+
+inline void reset() {
+    if constexpr (enabled) {
+        current() = stats_t();
+    }
+}
+
+inline void consumed(size_t bytes) {
+    if constexpr (enabled) {
+        current().bytes_consumed += bytes;
+    }
+}
+
+template <typename Type> inline void node(Type type) {
+    if constexpr (enabled) {
+        current().nodes[static_cast<size_t>(type)]++;
+    }
+}
+
+inline void allocated(size_t bytes) {
+    if constexpr (enabled) {
+        current().bytes_allocated += bytes;
+    }
+}
+
+inline void depth(size_t depth) {
+    if constexpr (enabled) {
+        if (depth > current().max_depth) {
+            current().max_depth = depth;
+        }
+    }
+}
+
+inline void lookup() {
+    if constexpr (enabled) {
+        current().lookups++;
+    }
+}
+
+inline void probes(size_t count) {
+    if constexpr (enabled) {
+        current().probes += count;
+    }
+}
+
+inline void allocation() {
+    if constexpr (enabled) {
+        current().allocations++;
+    }
+}
+
+// Adds the lifetime of the object to the time of `phase`.
+class timer {
+  public:
+    timer(Phase phase) : phase(phase) {
+        if constexpr (enabled) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~timer() {
+        if constexpr (enabled) {
+            auto end = std::chrono::steady_clock::now();
+            current().phase_ms[static_cast<size_t>(phase)] +=
+                    std::chrono::duration<double, std::milli>(end - start)
+                            .count();
+        }
+    }
+
+  private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace stats
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <expr_parser.hpp>
+#include <istream>
+#include <json_parser.hpp>
+#include <string>
+#include <vector>
+
+// Evaluating several expressions in one forward pass over a document,
+// without building its tree. The JSON paths of all expressions are compiled
+// into an automaton (a trie of keys, list indices and wildcards for
+// computed indices), which the scanner follows: values off every path are
+// skipped by bracket matching, and only values on a path are decoded. The
+// expressions then run on the sparse document holding just those values,
+// so memory depends on what the expressions reach, not on the size of the
+// document. Lists only aggregated over, as in max(a) or size(a.b) or
+// min(a.c.d), are folded while read into their size and the minimum and
+// maximum of their ints; other values a path ends at are kept whole.
+//
+// Skipped values are only checked for matching brackets and closed strings,
+// so e.g. a missing comma inside them goes unnoticed.
+namespace stream {
+
+struct result_t {
+    bool ok;
+    // The result as printed by the CLI, or the error message when !ok.
+    std::string value;
+};
+
+// Evaluates every expression against the document in `is`, returning one
+// result per expression. Syntax errors in the parts of the document that
+// are read throw std::runtime_error like json::parse, in the skipped parts
+// only mismatched brackets and unclosed strings do; only options.max_depth
+// applies.
+std::vector<result_t> evaluate(std::istream &is,
+                               const std::vector<expr::tree::Node *> &exprs,
+                               const json::options_t &options = {});
+
+} // namespace stream
+
+#endif
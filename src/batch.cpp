@@ -0,0 +1,468 @@
+#include <atomic>
+#include <batch.hpp>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <glob.h>
+#include <iomanip>
+#include <input.hpp>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <optional>
+#include <spanstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace batch {
+
+namespace {
+
+struct job_t {
+    size_t index;
+    std::string text;
+    std::string error;
+    // Bytes acquired from the budget for the file, released once evaluated.
+    size_t reserved = 0;
+};
+
+template <typename T> class queue_t {
+  public:
+    void push(T &&value) {
+        {
+            std::lock_guard lock(mutex);
+            items.push_back(std::move(value));
+        }
+        cv.notify_one();
+    }
+    void close() {
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+    std::optional<T> pop() {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T value = std::move(items.front());
+        items.pop_front();
+        return value;
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+// Bytes read but not yet evaluated.
+class budget_t {
+  public:
+    budget_t(size_t max) : max(max) {}
+    bool try_acquire(size_t bytes) {
+        std::lock_guard lock(mutex);
+        if (used > 0 && used + bytes > max) {
+            return false;
+        }
+        used += bytes;
+        return true;
+    }
+    void acquire(size_t bytes) {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return used == 0 || used + bytes <= max; });
+        used += bytes;
+    }
+    void release(size_t bytes) {
+        {
+            std::lock_guard lock(mutex);
+            used -= bytes;
+        }
+        cv.notify_all();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t used = 0;
+    size_t max;
+};
+
+// Minimal io_uring driver for reads, on raw system calls.
+class uring {
+  public:
+    ~uring() {
+        if (sq_ptr != MAP_FAILED) {
+            munmap(sq_ptr, sq_size);
+        }
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+            munmap(cq_ptr, cq_size);
+        }
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // False when io_uring is unavailable (old kernel, seccomp, ...).
+    bool init(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) {
+            return false;
+        }
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            return false;
+        }
+        cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP)
+                         ? sq_ptr
+                         : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+            return false;
+        }
+        auto sq = static_cast<char *>(sq_ptr);
+        sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        auto cq = static_cast<char *>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // Queues a read; at most `entries` may be queued between submits.
+    void read(int file, char *buf, unsigned len, uint64_t offset,
+              uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        auto &sqe = static_cast<io_uring_sqe *>(sqes)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail).store(tail + 1,
+                                                  std::memory_order_release);
+        ++queued;
+    }
+
+    // Submits the queued reads and waits for at least one completion, then
+    // calls f(user_data, result) for each.
+    template <typename F> bool wait(F &&f) {
+        int ret = syscall(__NR_io_uring_enter, fd, queued, 1,
+                          IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR) {
+            return false;
+        }
+        queued = 0;
+        unsigned head = *cq_head;
+        unsigned tail =
+                std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe = cqes[head & cq_mask];
+            f(cqe.user_data, cqe.res);
+        }
+        std::atomic_ref<unsigned>(*cq_head).store(head,
+                                                  std::memory_order_release);
+        return true;
+    }
+
+  private:
+    int fd = -1;
+    void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED, *sqes = MAP_FAILED;
+    size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+    unsigned *sq_tail = nullptr, *sq_array = nullptr;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr;
+    unsigned sq_mask = 0, cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+    unsigned queued = 0;
+};
+
+// Largest single read; longer files are read in several pieces.
+constexpr size_t max_read = 1 << 30;
+
+class reader_t {
+  public:
+    reader_t(const std::vector<std::string> &files, const options_t &options,
+             budget_t &budget, queue_t<job_t> &jobs)
+        : files(files), options(options), budget(budget), jobs(jobs) {}
+
+    void run() {
+        uring ring;
+        if (!ring.init(options.queue_depth) || !read_async(ring)) {
+            read_blocking();
+        }
+        jobs.close();
+    }
+
+  private:
+    struct pending_t {
+        size_t index;
+        int fd;
+        std::string text;
+        size_t done;
+        // The file's size when opened, acquired from the budget.
+        size_t reserved;
+    };
+
+    void read_blocking() {
+        for (; next < files.size(); ++next) {
+            std::ifstream is(files[next], std::ios::binary);
+            if (!is.is_open()) {
+                jobs.push({next, "", "Failed to open file"});
+                continue;
+            }
+            is.seekg(0, std::ios::end);
+            auto size = is.tellg();
+            if (size < 0) {
+                jobs.push({next, "", "Failed to read file"});
+                continue;
+            }
+            std::string text(size, '\0');
+            is.seekg(0);
+            budget.acquire(text.size());
+            if (!is.read(text.data(), text.size())) {
+                budget.release(text.size());
+                jobs.push({next, "",
+                           is.eof() ? "File changed while reading"
+                                    : "Failed to read file"});
+                continue;
+            }
+            size_t reserved = text.size();
+            jobs.push({next, std::move(text), "", reserved});
+        }
+    }
+
+    // Keeps up to queue_depth files in flight. Returns false if io_uring
+    // fails, leaving the remaining files to read_blocking().
+    bool read_async(uring &ring) {
+        std::vector<std::optional<pending_t>> slots(options.queue_depth);
+        size_t active = 0;
+        while (next < files.size() || active > 0) {
+            for (size_t slot = 0;
+                 slot < slots.size() && next < files.size(); ++slot) {
+                if (slots[slot]) {
+                    continue;
+                }
+                auto pending = open(active > 0);
+                if (!pending) {
+                    break;
+                }
+                if (pending->text.empty()) {
+                    close(pending->fd);
+                    finish(*pending);
+                    continue;
+                }
+                slots[slot] = std::move(pending);
+                submit(ring, slot, *slots[slot]);
+                ++active;
+            }
+            if (active == 0) {
+                continue;
+            }
+            bool ok = ring.wait([&](uint64_t slot, int res) {
+                auto &pending = *slots[slot];
+                if (res < 0) {
+                    jobs.push({pending.index, "", std::strerror(-res)});
+                    budget.release(pending.reserved);
+                } else if (res == 0) {
+                    // The file ended before the size it had when opened.
+                    jobs.push({pending.index, "", "File changed while reading"});
+                    budget.release(pending.reserved);
+                } else if (pending.done + res < pending.text.size()) {
+                    pending.done += res;
+                    submit(ring, slot, pending);
+                    return;
+                } else {
+                    finish(pending);
+                }
+                close(pending.fd);
+                slots[slot].reset();
+                --active;
+            });
+            if (!ok) {
+                for (auto &pending : slots) {
+                    if (pending) {
+                        jobs.push({pending->index, "", "io_uring read failed"});
+                        budget.release(pending->reserved);
+                        close(pending->fd);
+                    }
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Opens the next file and reserves its size in the budget. Returns
+    // nullopt when no files are left, or when the budget is full while
+    // other reads are active, which should complete first.
+    std::optional<pending_t> open(bool others_active) {
+        while (next < files.size()) {
+            size_t index = next;
+            int fd = ::open(files[index].c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) < 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                jobs.push({index, "", "Failed to open file"});
+                ++next;
+                continue;
+            }
+            size_t size = st.st_size;
+            if (others_active) {
+                if (!budget.try_acquire(size)) {
+                    close(fd);
+                    return std::nullopt;
+                }
+            } else {
+                budget.acquire(size);
+            }
+            ++next;
+            return pending_t{index, fd, std::string(size, '\0'), 0, size};
+        }
+        return std::nullopt;
+    }
+
+    void submit(uring &ring, size_t slot, pending_t &pending) {
+        size_t left = pending.text.size() - pending.done;
+        ring.read(pending.fd, pending.text.data() + pending.done,
+                  std::min(left, max_read), pending.done, slot);
+    }
+
+    void finish(pending_t &pending) {
+        jobs.push({pending.index, std::move(pending.text), "",
+                   pending.reserved});
+    }
+
+    const std::vector<std::string> &files;
+    const options_t &options;
+    budget_t &budget;
+    queue_t<job_t> &jobs;
+    size_t next = 0;
+};
+
+} // namespace
+
+std::string evaluate(const expr::tree::Node &expr, json::ref_t json) {
+    if (expr.ret_type == expr::RetType::INT) {
+        // Whole numbers print all their digits, not six significant ones.
+        expr::eval_t value = expr.eval(json);
+        if (value == std::trunc(value) && std::abs(value) < 0x1p63) {
+            return std::to_string(static_cast<int64_t>(value));
+        }
+        std::ostringstream ss;
+        if (value == std::trunc(value)) {
+            ss << std::fixed << std::setprecision(0);
+        }
+        ss << value;
+        return std::move(ss).str();
+    }
+    return expr.to_string(json);
+}
+
+std::vector<std::string> expand(const std::vector<std::string> &args) {
+    std::vector<std::string> files;
+    for (const auto &arg : args) {
+        if (arg.starts_with("@")) {
+            std::ifstream is(arg.substr(1));
+            if (!is.is_open()) {
+                throw std::runtime_error("Failed to open file list: " +
+                                         arg.substr(1));
+            }
+            for (std::string line; std::getline(is, line);) {
+                if (!line.empty()) {
+                    files.push_back(line);
+                }
+            }
+        } else if (arg.find_first_of("*?[") != std::string::npos) {
+            glob_t g;
+            if (glob(arg.c_str(), 0, nullptr, &g) == 0) {
+                for (size_t i = 0; i < g.gl_pathc; ++i) {
+                    files.push_back(g.gl_pathv[i]);
+                }
+            }
+            globfree(&g);
+        } else {
+            files.push_back(arg);
+        }
+    }
+    return files;
+}
+
+bool run(const std::vector<std::string> &files, const expr::tree::Node &expr,
+         const options_t &options, const callback_t &callback) {
+    budget_t budget(options.max_in_flight);
+    queue_t<job_t> jobs;
+    std::mutex output;
+    std::atomic<bool> ok = true;
+
+    auto work = [&] {
+        while (auto job = jobs.pop()) {
+            result_t result{files[job->index], job->error.empty(), job->error};
+            if (result.ok) {
+                try {
+                    std::ispanstream is(job->text);
+                    auto decompressed = io::decompress(is);
+                    auto json = json::parse(decompressed ? *decompressed : is,
+                                            options.parse);
+                    result.value = evaluate(expr, json.get());
+                } catch (const std::exception &e) {
+                    result.ok = false;
+                    result.value = e.what();
+                }
+                budget.release(job->reserved);
+            }
+            if (!result.ok) {
+                ok = false;
+            }
+            std::lock_guard lock(output);
+            callback(result);
+        }
+    };
+
+    size_t threads = options.threads ? options.threads
+                                     : std::thread::hardware_concurrency();
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+        workers.emplace_back(work);
+    }
+    reader_t(files, options, budget, jobs).run();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return ok;
+}
+
+} // namespace batch
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <batch.hpp>
+#include <condition_variable>
+#include <deque>
+#include <executor.hpp>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace query {
+
+namespace {
+
+struct job_t {
+    const expr::tree::Node *expr;
+    // Exactly one of them is set.
+    callback_t callback;
+    std::optional<std::promise<result_t>> promise;
+};
+
+} // namespace
+
+struct Executor::state_t {
+    json::ref_t document;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<job_t> jobs;
+    bool closed = false;
+    std::vector<std::thread> workers;
+
+    void push(job_t &&job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+    // Lets the workers finish the queued jobs and joins them.
+    void stop() {
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        cv.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    void work() {
+        while (true) {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] { return closed || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job_t job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            result_t result{true, {}};
+            try {
+                result.value = batch::evaluate(*job.expr, document);
+            } catch (const std::exception &e) {
+                result = {false, e.what()};
+            }
+            if (job.promise) {
+                job.promise->set_value(std::move(result));
+            } else {
+                job.callback(result);
+            }
+        }
+    }
+};
+
+Executor::Executor(json::ref_t document, const options_t &options)
+    : state(std::make_unique<state_t>()) {
+    state->document = document;
+    size_t threads = options.threads ? options.threads
+                                     : std::thread::hardware_concurrency();
+    // The destructor does not run if a thread fails to start, so the ones
+    // already started are stopped here.
+    try {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+            state->workers.emplace_back([this] { state->work(); });
+        }
+    } catch (...) {
+        state->stop();
+        throw;
+    }
+}
+
+Executor::~Executor() { state->stop(); }
+
+std::future<result_t> Executor::submit(const expr::tree::Node &expr) {
+    std::promise<result_t> promise;
+    auto future = promise.get_future();
+    state->push({&expr, nullptr, std::move(promise)});
+    return future;
+}
+
+void Executor::submit(const expr::tree::Node &expr, callback_t callback) {
+    state->push({&expr, std::move(callback), std::nullopt});
+}
+
+size_t Executor::threads() const { return state->workers.size(); }
+
+} // namespace query
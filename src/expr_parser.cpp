@@ -1,12 +1,13 @@
 #include "parser.hpp"
 #include <expr_parser.hpp>
-#include <stdexcept>
+#include <stats.hpp>
 
 namespace expr {
 
 class expr_parser : public parser::Parser {
   public:
-    expr_parser(std::istream *is_) : Parser(is_) {}
+    expr_parser(std::istream *is_, bool throws) : Parser(is_, throws) {}
+    expr_t expression();
     expr_t term();
     expr_t add();
     expr_t mul();
@@ -64,9 +65,12 @@ expr_t expr_parser::mul() {
 }
 
 expr_t expr_parser::number() {
-    int n = 0;
+    int64_t n = 0;
     while (!eof() && std::isdigit(next())) {
-        n = n * 10 + (next() - '0');
+        if (!json::push_digit(n, next())) {
+            fail(error::Code::INTEGER_RANGE);
+            break;
+        }
         advance();
     }
     return std::make_unique<tree::IntNode>(n);
@@ -115,11 +119,25 @@ std::string expr_parser::identifier() {
     return s;
 }
 
+expr_t expr_parser::expression() {
+    stats::timer timer(stats::Phase::EXPR_PARSE);
+    expr_t result = add();
+    if (!failed() && !eof()) {
+        fail(error::Code::EXPR_EOF_EXPECTED);
+    }
+    return result;
+}
+
 expr_t parse(std::istream &is) {
-    expr_parser parser(&is);
-    expr_t result = parser.add();
-    if (!parser.eof()) {
-        throw std::runtime_error("EXPR_PARSE: EOF expected");
+    expr_parser parser(&is, true);
+    return parser.expression();
+}
+
+error::result_t<expr_t> try_parse(std::istream &is) {
+    expr_parser parser(&is, false);
+    expr_t result = parser.expression();
+    if (parser.failed()) {
+        return std::unexpected(parser.error());
     }
     return result;
 }
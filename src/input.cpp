@@ -0,0 +1,292 @@
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <input.hpp>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace io {
+
+namespace {
+
+constexpr size_t input_chunk = 64 << 10;
+
+// Streambuf fed by a decompression thread. The thread fills blocks of
+// block_size bytes and queues up to queue_depth of them; underflow() takes
+// the next one.
+class decompress_buf : public std::streambuf {
+  public:
+    decompress_buf(std::istream &is, Format format, const options_t &options)
+        : is(is), format(format), options(options) {
+        worker = std::thread([this] { run(); });
+    }
+    ~decompress_buf() override {
+        {
+            std::lock_guard lock(mutex);
+            stopped = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+  protected:
+    int_type underflow() override {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] { return !blocks.empty() || done; });
+        if (blocks.empty()) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return traits_type::eof();
+        }
+        current = std::move(blocks.front());
+        blocks.pop_front();
+        lock.unlock();
+        cv.notify_all();
+        setg(current.data(), current.data(), current.data() + current.size());
+        return traits_type::to_int_type(current[0]);
+    }
+
+  private:
+    void run() {
+        try {
+            switch (format) {
+            case Format::GZIP:
+                gzip();
+                break;
+            case Format::ZSTD:
+                zstd();
+                break;
+            case Format::PLAIN:
+                break;
+            }
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard lock(mutex);
+            done = true;
+        }
+        cv.notify_all();
+    }
+
+    // Reads the next chunk of compressed input, empty at EOF.
+    std::vector<char> &read() {
+        in.resize(input_chunk);
+        is.read(in.data(), in.size());
+        in.resize(is.gcount());
+        return in;
+    }
+
+    // Queues a full (or final) block. Returns false if the reader is gone.
+    bool emit(std::string &block) {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] {
+            return blocks.size() < options.queue_depth || stopped;
+        });
+        if (stopped) {
+            return false;
+        }
+        blocks.push_back(std::move(block));
+        lock.unlock();
+        cv.notify_all();
+        block = std::string();
+        return true;
+    }
+
+    void gzip() {
+#ifdef HAVE_ZLIB
+        z_stream z = {};
+        // 15 window bits, +32 to accept gzip and zlib headers.
+        if (inflateInit2(&z, 15 + 32) != Z_OK) {
+            throw std::runtime_error("INPUT: Failed to initialize zlib");
+        }
+        std::string block(options.block_size, '\0');
+        size_t filled = 0;
+        int ret = Z_OK;
+        // The last inflate() filled the block and may have more output.
+        bool pending = false;
+        try {
+            while (true) {
+                if (z.avail_in == 0 && !pending) {
+                    auto &chunk = read();
+                    if (chunk.empty()) {
+                        break;
+                    }
+                    z.next_in = reinterpret_cast<Bytef *>(chunk.data());
+                    z.avail_in = chunk.size();
+                }
+                if (ret == Z_STREAM_END && z.avail_in > 0) {
+                    // Concatenated gzip members.
+                    inflateReset(&z);
+                }
+                z.next_out = reinterpret_cast<Bytef *>(block.data() + filled);
+                z.avail_out = block.size() - filled;
+                ret = inflate(&z, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    throw std::runtime_error("INPUT: Corrupt gzip stream");
+                }
+                filled = block.size() - z.avail_out;
+                pending = filled == block.size();
+                if (pending) {
+                    if (!emit(block)) {
+                        inflateEnd(&z);
+                        return;
+                    }
+                    block.resize(options.block_size);
+                    filled = 0;
+                }
+            }
+            if (ret != Z_STREAM_END) {
+                throw std::runtime_error("INPUT: Truncated gzip stream");
+            }
+        } catch (...) {
+            inflateEnd(&z);
+            throw;
+        }
+        inflateEnd(&z);
+        block.resize(filled);
+        if (!block.empty()) {
+            emit(block);
+        }
+#else
+        throw std::runtime_error("INPUT: gzip support not compiled in");
+#endif
+    }
+
+    void zstd() {
+#ifdef HAVE_ZSTD
+        ZSTD_DStream *z = ZSTD_createDStream();
+        ZSTD_initDStream(z);
+        std::string block(options.block_size, '\0');
+        ZSTD_outBuffer out = {block.data(), block.size(), 0};
+        size_t ret = 0;
+        try {
+            while (true) {
+                auto &chunk = read();
+                if (chunk.empty()) {
+                    break;
+                }
+                ZSTD_inBuffer input = {chunk.data(), chunk.size(), 0};
+                // A full output block may leave data buffered in the
+                // decoder, so keep going until it has room to spare.
+                bool full = false;
+                do {
+                    ret = ZSTD_decompressStream(z, &out, &input);
+                    if (ZSTD_isError(ret)) {
+                        throw std::runtime_error(
+                                "INPUT: Corrupt zstd stream");
+                    }
+                    full = out.pos == out.size;
+                    if (full) {
+                        if (!emit(block)) {
+                            ZSTD_freeDStream(z);
+                            return;
+                        }
+                        block.resize(options.block_size);
+                        out = {block.data(), block.size(), 0};
+                    }
+                } while (input.pos < input.size || full);
+            }
+            if (ret != 0) {
+                throw std::runtime_error("INPUT: Truncated zstd stream");
+            }
+        } catch (...) {
+            ZSTD_freeDStream(z);
+            throw;
+        }
+        ZSTD_freeDStream(z);
+        block.resize(out.pos);
+        if (!block.empty()) {
+            emit(block);
+        }
+#else
+        throw std::runtime_error("INPUT: zstd support not compiled in");
+#endif
+    }
+
+    std::istream &is;
+    Format format;
+    options_t options;
+    std::vector<char> in;
+    std::string current;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> blocks;
+    bool done = false;
+    bool stopped = false;
+    std::exception_ptr error;
+    std::thread worker;
+};
+
+class decompress_stream : public std::istream {
+  public:
+    decompress_stream(std::istream &is, Format format,
+                      const options_t &options)
+        : std::istream(nullptr), buf(is, format, options) {
+        rdbuf(&buf);
+        // Let errors from the decompression thread reach the caller.
+        exceptions(std::ios::badbit);
+    }
+
+  private:
+    decompress_buf buf;
+};
+
+} // namespace
+
+Format detect(std::istream &is) {
+    unsigned char magic[4] = {};
+    auto pos = is.tellg();
+    is.read(reinterpret_cast<char *>(magic), sizeof(magic));
+    size_t n = is.gcount();
+    is.clear();
+    if (pos != std::streampos(-1)) {
+        is.seekg(pos);
+    } else {
+        for (size_t i = n; i > 0; --i) {
+            is.putback(magic[i - 1]);
+        }
+    }
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return Format::GZIP;
+    }
+    if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+        magic[3] == 0xfd) {
+        return Format::ZSTD;
+    }
+    return Format::PLAIN;
+}
+
+std::unique_ptr<std::istream> decompress(std::istream &is,
+                                         const options_t &options) {
+    Format format = detect(is);
+    if (format == Format::PLAIN) {
+        return nullptr;
+    }
+#ifndef HAVE_ZLIB
+    if (format == Format::GZIP) {
+        throw std::runtime_error("INPUT: gzip support not compiled in");
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (format == Format::ZSTD) {
+        throw std::runtime_error("INPUT: zstd support not compiled in");
+    }
+#endif
+    return std::make_unique<decompress_stream>(is, format, options);
+}
+
+} // namespace io
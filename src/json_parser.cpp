@@ -1,100 +1,288 @@
+#include <algorithm>
 #include <json_parser.hpp>
 #include <parser.hpp>
-#include <stdexcept>
+#include <stats.hpp>
 
 namespace json {
 
 class json_parser : public parser::Parser {
   private:
-    friend json_t parse(std::istream &is);
-    json_parser(std::istream *_is) : parser::Parser(_is) {}
+    friend json_t parse(std::istream &is, const options_t &options);
+    friend error::result_t<json_t> try_parse(std::istream &is,
+                                             const options_t &options);
+    json_parser(std::istream *_is, const options_t &options, bool throws)
+        : parser::Parser(_is, throws), options(options) {}
+    json_t document();
     json_t object();
-    json_t dict();
-    json_t list();
     json_t value();
     std::string string();
-    int number();
+    void string_tail(std::string &result);
+    int64_t number();
+
+    // A dict or list whose elements are still being parsed.
+    struct frame_t {
+        tree::Type type;
+        tree::dict_t dict;
+        tree::list_t list;
+        std::string key;
+        // The expected shape of the container and of its next value, with
+        // options.schema.
+        const schema_t *shape = nullptr;
+        const schema_t *child = nullptr;
+        // Dicts: the next key expected, and whether all keys so far were.
+        size_t field = 0;
+        bool predicted = true;
+    };
+    void open(tree::Type type);
+    json_t close();
+    void key();
+    void charge(size_t bytes);
+
+    const options_t &options;
+    std::vector<frame_t> stack;
+    size_t used = 0;
 };
 
+// Heap bytes of a string outside the small string buffer.
+static size_t heap_bytes(const std::string &s) {
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+// Estimated bytes of one dict entry: the entry itself plus the index hash
+// node, its bucket slot and the cached hash.
+static constexpr size_t dict_entry_bytes =
+        sizeof(tree::dict_t::value_type) +
+        sizeof(std::pair<std::string_view, size_t>) + 3 * sizeof(void *);
+
 json_t json_parser::object() {
-    switch (next()) {
-    case '{':
-        return dict();
-    case '[':
-        return list();
-    default:
-        return value();
+    json_t result;
+    while (!failed()) {
+        switch (next()) {
+        case '{':
+            open(tree::Type::DICT);
+            if (failed()) {
+                return nullptr;
+            }
+            if (next() != '}') {
+                key();
+                continue;
+            }
+            result = close();
+            break;
+        case '[':
+            open(tree::Type::LIST);
+            if (failed()) {
+                return nullptr;
+            }
+            if (next() != ']') {
+                continue;
+            }
+            result = close();
+            break;
+        default:
+            result = value();
+            if (failed()) {
+                return nullptr;
+            }
+        }
+
+        // Hand the finished value to the enclosing containers, closing every
+        // one that ends here.
+        while (!stack.empty()) {
+            frame_t &top = stack.back();
+            if (top.type == tree::Type::DICT) {
+                charge(dict_entry_bytes + heap_bytes(top.key));
+                top.dict.emplace_back(std::move(top.key), std::move(result));
+            } else {
+                charge(sizeof(tree::ptr_t));
+                top.list.push_back(std::move(result));
+            }
+            if (next() == ',') {
+                advance();
+                if (top.type == tree::Type::DICT) {
+                    key();
+                }
+                break;
+            }
+            result = close();
+        }
+        if (stack.empty()) {
+            return result;
+        }
     }
+    return nullptr;
 }
 
-json_t json_parser::dict() {
-    expect('{');
-    tree::dict_t dict;
-    if (next() != '}') {
-        std::string key = string();
-        expect(':');
-        dict[key] = object();
+// Most elements reserved ahead from a schema: the sample's sizes are only a
+// guess, and space reserved is not charged to options.max_bytes until the
+// elements arrive.
+static constexpr size_t reserve_limit = 64;
+
+void json_parser::open(tree::Type type) {
+    advance();
+    if (stack.size() >= options.max_depth) {
+        fail(error::Code::MAX_DEPTH);
+        return;
     }
-    while (next() == ',') {
-        advance();
-        std::string key = string();
-        expect(':');
-        dict[key] = object();
+    const schema_t *shape = stack.empty() ? options.schema : stack.back().child;
+    stack.push_back({type});
+    stats::depth(stack.size());
+    if (!shape || shape->type != type) {
+        return;
+    }
+    frame_t &top = stack.back();
+    top.shape = shape;
+    if (type == tree::Type::DICT) {
+        top.dict.reserve(std::min(shape->keys.size(), reserve_limit));
+    } else {
+        top.list.reserve(std::min(shape->size, reserve_limit));
+        top.child = shape->values.empty() ? nullptr : &shape->values[0];
     }
-    expect('}');
-    return std::make_unique<tree::DictNode>(std::move(dict));
 }
 
-json_t json_parser::list() {
-    expect('[');
-    tree::list_t list;
-    if (next() != ']') {
-        list.push_back(object());
+json_t json_parser::close() {
+    frame_t &top = stack.back();
+    json_t result;
+    if (top.type == tree::Type::DICT) {
+        expect('}');
+        charge(sizeof(tree::DictNode));
+        stats::node(tree::Type::DICT);
+        const schema_t *shape = top.shape;
+        if (shape && shape->index && top.predicted &&
+            top.dict.size() == shape->keys.size()) {
+            result = std::make_unique<tree::DictNode>(std::move(top.dict),
+                                                      shape->index);
+        } else {
+            result = std::make_unique<tree::DictNode>(std::move(top.dict));
+        }
+    } else {
+        expect(']');
+        charge(sizeof(tree::ListNode));
+        stats::node(tree::Type::LIST);
+        result = std::make_unique<tree::ListNode>(std::move(top.list));
     }
-    while (next() == ',') {
-        advance();
-        list.push_back(object());
+    stack.pop_back();
+    return result;
+}
+
+void json_parser::key() {
+    frame_t &top = stack.back();
+    const schema_t *shape = top.shape;
+    if (!shape) {
+        top.key = string();
+        expect(':');
+        return;
+    }
+    // Compare with the key expected next while reading it.
+    expect('"');
+    size_t matched = 0;
+    bool expected = top.field < shape->keys.size();
+    if (expected) {
+        const std::string &key = shape->keys[top.field];
+        while (matched < key.size() && !failed() && next() == key[matched]) {
+            advance();
+            ++matched;
+        }
+        if (matched == key.size() && !failed() && next() == '"') {
+            advance();
+            top.key = key;
+            top.child = &shape->values[top.field++];
+            expect(':');
+            return;
+        }
+    }
+    top.predicted = false;
+    top.key = expected ? shape->keys[top.field].substr(0, matched) : "";
+    string_tail(top.key);
+    // Keys out of order or optional keys still find their value's shape.
+    auto it = std::find(shape->keys.begin(), shape->keys.end(), top.key);
+    if (it != shape->keys.end()) {
+        top.field = it - shape->keys.begin();
+        top.child = &shape->values[top.field++];
+    } else {
+        top.child = nullptr;
+    }
+    expect(':');
+}
+
+void json_parser::charge(size_t bytes) {
+    used += bytes;
+    stats::allocated(bytes);
+    if (options.max_bytes && used > options.max_bytes) {
+        fail(error::Code::MEMORY_BUDGET);
     }
-    expect(']');
-    return std::make_unique<tree::ListNode>(std::move(list));
 }
 
 json_t json_parser::value() {
     if (next() == '"') {
-        return std::make_unique<tree::StringNode>(string());
+        std::string value = string();
+        charge(sizeof(tree::StringNode) + heap_bytes(value));
+        stats::node(tree::Type::STRING);
+        return std::make_unique<tree::StringNode>(std::move(value));
     }
     if (std::isdigit(next())) {
+        charge(sizeof(tree::IntNode));
+        stats::node(tree::Type::INT);
         return std::make_unique<tree::IntNode>(number());
     }
-    throw std::runtime_error(
-            "JSON_PARSE: Unexpected character when parsing value");
+    fail(error::Code::UNEXPECTED_CHAR);
+    return nullptr;
 }
 
 std::string json_parser::string() {
     std::string result;
     expect('"');
-    while (next() != '"') {
+    string_tail(result);
+    return result;
+}
+
+// Reads the rest of a string after its opening quote.
+void json_parser::string_tail(std::string &result) {
+    while (next() != '"' && !failed()) {
         result.push_back(next());
         advance();
+        // Stop runaway strings before they are charged as a whole.
+        if (options.max_bytes && used + result.size() > options.max_bytes) {
+            fail(error::Code::MEMORY_BUDGET);
+        }
     }
     expect('"');
-    return result;
 }
 
-int json_parser::number() {
-    int result = 0;
+int64_t json_parser::number() {
+    int64_t result = 0;
     while (std::isdigit(next())) {
-        result = result * 10 + next() - '0';
+        if (!push_digit(result, next())) {
+            fail(error::Code::INTEGER_RANGE);
+            return 0;
+        }
         advance();
     }
     return result;
 }
 
-json_t parse(std::istream &is) {
-    json_parser parser(&is);
-    json_t result = parser.object();
-    if (!parser.eof()) {
-        throw std::runtime_error("JSON_PARSE: EOF expected");
+json_t json_parser::document() {
+    stats::timer timer(stats::Phase::PARSE);
+    json_t result = object();
+    stats::consumed(consumed());
+    if (!failed() && !eof()) {
+        fail(error::Code::JSON_EOF_EXPECTED);
+    }
+    return result;
+}
+
+json_t parse(std::istream &is, const options_t &options) {
+    json_parser parser(&is, options, true);
+    return parser.document();
+}
+
+json_t parse(std::istream &is) { return parse(is, options_t()); }
+
+error::result_t<json_t> try_parse(std::istream &is, const options_t &options) {
+    json_parser parser(&is, options, false);
+    json_t result = parser.document();
+    if (parser.failed()) {
+        return std::unexpected(parser.error());
     }
     return result;
 }
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <json_parser.hpp>
+#include <stats.hpp>
+
+namespace json {
+
+namespace {
+
+// Nesting tracked by the validator's bit stack, whatever options.max_depth
+// says.
+constexpr size_t stack_bits = 1 << 16;
+
+constexpr uint64_t ones = 0x0101010101010101ull;
+constexpr uint64_t highs = 0x8080808080808080ull;
+
+// Whether any byte of `x` is below `n` (n <= 128).
+constexpr uint64_t has_less(uint64_t x, uint8_t n) {
+    return (x - ones * n) & ~x & highs;
+}
+
+constexpr uint64_t has_byte(uint64_t x, uint8_t c) {
+    return has_less(x ^ (ones * c), 1);
+}
+
+// A state machine over the text. Containers are tracked with one bit per
+// level (set for dicts), so the only memory used is the fixed bit stack.
+class validator {
+  public:
+    validator(std::string_view text, size_t max_depth)
+        : begin(text.data()), p(text.data()), end(text.data() + text.size()),
+          max_depth(std::min(max_depth, stack_bits)) {}
+
+    error::result_t<void> run() {
+        whitespace();
+        while (true) {
+            Step step = value();
+            if (step == Step::FAIL) {
+                return std::unexpected(error);
+            }
+            if (step == Step::OPEN) {
+                continue;
+            }
+            // Close every container that ends after this value.
+            while (true) {
+                whitespace();
+                if (depth == 0) {
+                    if (p != end) {
+                        return fail(error::Code::JSON_EOF_EXPECTED);
+                    }
+                    return {};
+                }
+                if (p == end) {
+                    return fail(error::Code::UNEXPECTED_EOF);
+                }
+                bool dict = top();
+                if (*p == ',') {
+                    ++p;
+                    whitespace();
+                    if (dict && !key()) {
+                        return std::unexpected(error);
+                    }
+                    break;
+                }
+                if (*p != (dict ? '}' : ']')) {
+                    return fail(error::Code::EXPECTED_CHAR, dict ? '}' : ']');
+                }
+                ++p;
+                --depth;
+            }
+        }
+    }
+
+  private:
+    enum class Step {
+        FAIL,
+        // A whole value, or an empty container left for the caller to close.
+        VALUE,
+        // A container with its first key, its first value comes next.
+        OPEN,
+    };
+
+    Step value() {
+        if (p == end) {
+            set(error::Code::UNEXPECTED_EOF);
+            return Step::FAIL;
+        }
+        bool ok;
+        switch (*p) {
+        case '{':
+        case '[': {
+            bool dict = *p == '{';
+            if (depth >= max_depth) {
+                set(error::Code::MAX_DEPTH);
+                return Step::FAIL;
+            }
+            push(dict);
+            ++p;
+            whitespace();
+            if (p != end && *p == (dict ? '}' : ']')) {
+                return Step::VALUE;
+            }
+            if (dict && !key()) {
+                return Step::FAIL;
+            }
+            return Step::OPEN;
+        }
+        case '"':
+            ok = string();
+            break;
+        case 't':
+            ok = literal("true");
+            break;
+        case 'f':
+            ok = literal("false");
+            break;
+        case 'n':
+            ok = literal("null");
+            break;
+        default:
+            if (*p == '-' || (*p >= '0' && *p <= '9')) {
+                ok = number();
+            } else {
+                ok = set(error::Code::UNEXPECTED_CHAR);
+            }
+        }
+        return ok ? Step::VALUE : Step::FAIL;
+    }
+
+    // A dict key and its colon, leaving p at the value.
+    bool key() {
+        if (p == end) {
+            return set(error::Code::UNEXPECTED_EOF);
+        }
+        if (*p != '"') {
+            return set(error::Code::EXPECTED_CHAR, '"');
+        }
+        if (!string()) {
+            return false;
+        }
+        whitespace();
+        if (p == end) {
+            return set(error::Code::UNEXPECTED_EOF);
+        }
+        if (*p != ':') {
+            return set(error::Code::EXPECTED_CHAR, ':');
+        }
+        ++p;
+        whitespace();
+        return true;
+    }
+
+    bool string() {
+        ++p;
+        while (true) {
+            // Skip eight plain ASCII bytes at a time.
+            uint64_t word;
+            while (end - p >= 8) {
+                std::memcpy(&word, p, 8);
+                if (has_byte(word, '"') | has_byte(word, '\\') |
+                    has_less(word, 0x20) | (word & highs)) {
+                    break;
+                }
+                p += 8;
+            }
+            if (p == end) {
+                return set(error::Code::UNEXPECTED_EOF);
+            }
+            unsigned char c = *p;
+            if (c == '"') {
+                ++p;
+                return true;
+            }
+            if (c == '\\') {
+                if (!escape()) {
+                    return false;
+                }
+            } else if (c < 0x20) {
+                return set(error::Code::CONTROL_CHAR);
+            } else if (c >= 0x80) {
+                if (!utf8()) {
+                    return false;
+                }
+            } else {
+                ++p;
+            }
+        }
+    }
+
+    bool escape() {
+        if (end - p < 2) {
+            p = end;
+            return set(error::Code::UNEXPECTED_EOF);
+        }
+        switch (p[1]) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            p += 2;
+            return true;
+        case 'u':
+            if (end - p < 6) {
+                p = end;
+                return set(error::Code::UNEXPECTED_EOF);
+            }
+            for (int i = 2; i < 6; ++i) {
+                if (!std::isxdigit(static_cast<unsigned char>(p[i]))) {
+                    return set(error::Code::INVALID_ESCAPE);
+                }
+            }
+            p += 6;
+            return true;
+        }
+        return set(error::Code::INVALID_ESCAPE);
+    }
+
+    // One multi-byte sequence: no overlong forms, no surrogates, nothing
+    // above U+10FFFF.
+    bool utf8() {
+        auto byte = [this](ptrdiff_t i) {
+            return static_cast<unsigned char>(p[i]);
+        };
+        unsigned char c = byte(0);
+        int length;
+        unsigned char low = 0x80, high = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            length = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            length = 3;
+            low = c == 0xe0 ? 0xa0 : 0x80;
+            high = c == 0xed ? 0x9f : 0xbf;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            length = 4;
+            low = c == 0xf0 ? 0x90 : 0x80;
+            high = c == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            return set(error::Code::INVALID_UTF8);
+        }
+        if (end - p < length) {
+            return set(error::Code::INVALID_UTF8);
+        }
+        if (byte(1) < low || byte(1) > high) {
+            return set(error::Code::INVALID_UTF8);
+        }
+        for (int i = 2; i < length; ++i) {
+            if (byte(i) < 0x80 || byte(i) > 0xbf) {
+                return set(error::Code::INVALID_UTF8);
+            }
+        }
+        p += length;
+        return true;
+    }
+
+    bool number() {
+        const char *start = p;
+        if (*p == '-') {
+            ++p;
+        }
+        if (p == end || !digit()) {
+            return set(error::Code::INVALID_NUMBER, 0, start);
+        }
+        if (*p++ != '0') {
+            digits();
+        }
+        if (p != end && *p == '.') {
+            ++p;
+            if (p == end || !digit()) {
+                return set(error::Code::INVALID_NUMBER, 0, start);
+            }
+            digits();
+        }
+        if (p != end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            if (p != end && (*p == '+' || *p == '-')) {
+                ++p;
+            }
+            if (p == end || !digit()) {
+                return set(error::Code::INVALID_NUMBER, 0, start);
+            }
+            digits();
+        }
+        return true;
+    }
+
+    bool digit() const { return *p >= '0' && *p <= '9'; }
+    void digits() {
+        while (p != end && digit()) {
+            ++p;
+        }
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<size_t>(end - p) < word.size() ||
+            std::memcmp(p, word.data(), word.size()) != 0) {
+            return set(error::Code::INVALID_LITERAL);
+        }
+        p += word.size();
+        return true;
+    }
+
+    void whitespace() {
+        while (p != end &&
+               (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            ++p;
+        }
+    }
+
+    void push(bool dict) {
+        uint64_t bit = 1ull << (depth % 64);
+        if (dict) {
+            stack[depth / 64] |= bit;
+        } else {
+            stack[depth / 64] &= ~bit;
+        }
+        ++depth;
+        stats::depth(depth);
+    }
+    bool top() const {
+        size_t i = depth - 1;
+        return stack[i / 64] >> (i % 64) & 1;
+    }
+
+    // Records an error at `at` (default p) and returns false.
+    bool set(error::Code code, char expected = 0, const char *at = nullptr) {
+        error = {code, expected, static_cast<size_t>((at ? at : p) - begin)};
+        return false;
+    }
+    error::result_t<void> fail(error::Code code, char expected = 0) {
+        set(code, expected);
+        return std::unexpected(error);
+    }
+
+    const char *begin, *p, *end;
+    size_t max_depth;
+    size_t depth = 0;
+    uint64_t stack[stack_bits / 64];
+    error::error_t error{};
+};
+
+} // namespace
+
+error::result_t<void> validate(std::string_view text,
+                               const options_t &options) {
+    stats::timer timer(stats::Phase::PARSE);
+    stats::consumed(text.size());
+    return validator(text, options.max_depth).run();
+}
+
+} // namespace json
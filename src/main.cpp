@@ -1,34 +1,366 @@
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <spanstream>
+#include <sstream>
+#include <string>
+#include <vector>
 
+#include <batch.hpp>
 #include <expr_parser.hpp>
+#include <input.hpp>
 #include <json_parser.hpp>
-#include <sstream>
+#include <profiled_expr.hpp>
+#include <serialize.hpp>
+#include <sidecar.hpp>
+#include <stats.hpp>
+#include <stream.hpp>
 
-int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << "<json_file> <expr>" << std::endl;
-        return 1;
+// Counts allocations for --explain and --profile.
+void *operator new(size_t size) {
+    stats::allocation();
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
     }
-    std::ifstream json_stream(argv[1]);
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Evaluations of each node measured by --profile: one in this many.
+static constexpr size_t profile_sample = 16;
+
+static void usage(const char *prog) {
+    // --stats only exists in builds with the counters (make STATS=1).
+    std::cerr << "Usage: " << prog << (stats::enabled ? " [--stats]" : "")
+              << " [--explain|--profile] [--max-depth <n>]"
+                 " [--max-bytes <n>] [--schema <sample>] <json_file> <expr>\n"
+              << "       " << prog
+              << " --batch [--profile] [--threads <n>] [--max-in-flight"
+                 " <bytes>] [--schema <sample>] <expr> <file|glob|@list>...\n"
+              << "       " << prog
+              << " --validate [--max-depth <n>] <json_file>\n"
+              << "       " << prog << " --index <json_file> <expr>\n"
+              << "       " << prog << " --stream <json_file> <expr>..."
+              << std::endl;
+}
+
+// Parses all of `text` as an unsigned number.
+static bool parse_size(const char *text, size_t &out) {
+    const char *end = text + std::strlen(text);
+    auto [stop, error] = std::from_chars(text, end, out);
+    return error == std::errc() && stop == end;
+}
+
+static void print_stats(std::ostream &os) {
+    static const char *types[] = {"int", "string", "dict", "list"};
+    static const char *phases[] = {"read", "parse", "expr parse", "eval",
+                                   "output"};
+    const auto &s = stats::current();
+    os << "bytes consumed:  " << s.bytes_consumed << "\n";
+    os << "bytes allocated: " << s.bytes_allocated << " (estimate)\n";
+    os << "max depth:       " << s.max_depth << "\n";
+    os << "lookups:         " << s.lookups << "\n";
+    os << "probes:          " << s.probes << "\n";
+    os << "allocations:     " << s.allocations << "\n";
+    for (size_t i = 0; i < stats::type_count; ++i) {
+        os << "nodes " << std::left << std::setw(10) << types[i] << s.nodes[i]
+           << "\n";
+    }
+    for (size_t i = 0; i < stats::phase_count; ++i) {
+        os << "time " << std::left << std::setw(11) << phases[i] << std::fixed
+           << std::setprecision(3) << s.phase_ms[i] << " ms\n";
+    }
+}
+
+// Evaluates `expr` and prints the result. Large JSON results are
+// serialized on several threads; profiled paths print through the wrapper
+// so that their cost is counted.
+static void print_result(const expr::tree::Node &expr, json::ref_t json) {
+    auto path = dynamic_cast<const expr::tree::JsonNode *>(&expr);
+    if (!path) {
+        std::string result;
+        {
+            stats::timer timer(stats::Phase::EVAL);
+            result = batch::evaluate(expr, json);
+        }
+        stats::timer timer(stats::Phase::OUTPUT);
+        std::cout << result << std::endl;
+        return;
+    }
+    json::ref_t value;
+    {
+        stats::timer timer(stats::Phase::EVAL);
+        value = error::value(path->resolve(json));
+    }
+    stats::timer timer(stats::Phase::OUTPUT);
+    json::serialize::write(std::cout, value);
+    std::cout << std::endl;
+}
+
+// Reads the whole file, decompressing it if needed.
+static std::string read_input(const std::string &path) {
+    stats::timer timer(stats::Phase::READ);
+    std::ifstream json_stream(path, std::ios::binary);
     if (!json_stream.is_open()) {
-        std::cerr << "Failed to open file: " << argv[1] << std::endl;
-        return 1;
+        throw std::runtime_error("Failed to open file: " + path);
     }
+    std::stringstream ss;
+    ss << json_stream.rdbuf();
+    std::string text = std::move(ss).str();
+    std::ispanstream is(text);
+    if (auto decompressed = io::decompress(is)) {
+        std::stringstream plain;
+        plain << decompressed->rdbuf();
+        text = std::move(plain).str();
+    }
+    return text;
+}
 
-    std::istringstream expr_stream(argv[2]);
+// Learns the schema of the documents from a sample file.
+static json::schema_t load_schema(const std::string &path) {
+    std::string text = read_input(path);
+    std::ispanstream is(text);
+    auto sample = json::parse(is);
+    return json::infer(sample.get());
+}
+
+static int run_validate(const std::string &path,
+                        const json::options_t &options) {
+    std::string text;
+    try {
+        text = read_input(path);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    auto result = json::validate(text, options);
+    if (!result) {
+        auto pos = error::position(text, result.error().offset);
+        std::cerr << "Error: " << error::message(result.error())
+                  << " at line " << pos.line << ", column " << pos.column
+                  << " (offset " << result.error().offset << ")" << std::endl;
+        return 1;
+    }
+    std::cout << "valid" << std::endl;
+    return 0;
+}
 
+// Queries through the file's sidecar index, building it if needed.
+static int run_indexed(const std::vector<std::string> &args,
+                       const json::options_t &options) {
+    std::istringstream expr_stream(args[1]);
     try {
-        auto json = json::parse(json_stream);
+        std::unique_ptr<json::sidecar::Document> doc;
+        {
+            stats::timer timer(stats::Phase::PARSE);
+            doc = json::sidecar::load(args[0], options);
+        }
         auto expr = expr::parse(expr_stream);
+        print_result(*expr, doc->root());
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Evaluates every expression in one pass over the file, without loading it.
+static int run_stream(const std::vector<std::string> &args,
+                      const json::options_t &options) {
+    std::vector<expr::expr_t> exprs;
+    std::vector<expr::tree::Node *> nodes;
+    std::vector<stream::result_t> results;
+    try {
+        for (auto it = args.begin() + 1; it != args.end(); ++it) {
+            std::istringstream expr_stream(*it);
+            exprs.push_back(expr::parse(expr_stream));
+            nodes.push_back(exprs.back().get());
+        }
+        std::ifstream json_stream(args[0], std::ios::binary);
+        if (!json_stream.is_open()) {
+            throw std::runtime_error("Failed to open file: " + args[0]);
+        }
+        auto decompressed = io::decompress(json_stream);
+        results = stream::evaluate(decompressed ? *decompressed : json_stream,
+                                   nodes, options);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    stats::timer timer(stats::Phase::OUTPUT);
+    bool ok = true;
+    for (const auto &result : results) {
+        if (result.ok) {
+            std::cout << result.value << "\n";
+        } else {
+            std::cout.flush();
+            std::cerr << "Error: " << result.value << std::endl;
+            ok = false;
+        }
+    }
+    std::cout.flush();
+    return ok ? 0 : 1;
+}
 
-        if (expr->ret_type == expr::RetType::INT) {
-            std::cout << expr->eval(json.get()) << std::endl;
+static int run_batch(const std::vector<std::string> &args,
+                     const batch::options_t &options, bool profile) {
+    std::istringstream expr_stream(args[0]);
+    expr::expr_t expr;
+    std::unique_ptr<expr::Profiled> profiled;
+    std::vector<std::string> files;
+    try {
+        expr = expr::parse(expr_stream);
+        files = batch::expand({args.begin() + 1, args.end()});
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (profile) {
+        profiled = std::make_unique<expr::Profiled>(std::move(expr),
+                                                    profile_sample);
+    }
+    const expr::tree::Node &node = profiled ? profiled->node() : *expr;
+    bool ok = batch::run(files, node, options, [](const batch::result_t &r) {
+        if (r.ok) {
+            std::cout << r.file << ": " << r.value << "\n";
         } else {
-            std::cout << expr->to_string(json.get()) << std::endl;
+            std::cerr << r.file << ": Error: " << r.value << "\n";
+        }
+    });
+    std::cout.flush();
+    if (profiled) {
+        profiled->explain(std::cerr);
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    bool show_stats = false;
+    bool batch_mode = false;
+    bool validate_mode = false;
+    bool index_mode = false;
+    bool stream_mode = false;
+    bool explain = false;
+    bool profile = false;
+    batch::options_t batch_options;
+    json::options_t &options = batch_options.parse;
+    std::string schema_path;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stats") {
+            if (!stats::enabled) {
+                usage(argv[0]);
+                return 1;
+            }
+            show_stats = true;
+        } else if (arg == "--batch") {
+            batch_mode = true;
+        } else if (arg == "--validate") {
+            validate_mode = true;
+        } else if (arg == "--index") {
+            index_mode = true;
+        } else if (arg == "--stream") {
+            stream_mode = true;
+        } else if (arg == "--explain") {
+            explain = true;
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--schema" && i + 1 < argc) {
+            schema_path = argv[++i];
+        } else if ((arg == "--max-depth" || arg == "--max-bytes" ||
+                    arg == "--threads" || arg == "--max-in-flight") &&
+                   i + 1 < argc) {
+            size_t value;
+            if (!parse_size(argv[++i], value)) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (arg == "--max-depth") {
+                options.max_depth = value;
+            } else if (arg == "--max-bytes") {
+                options.max_bytes = value;
+            } else if (arg == "--threads") {
+                batch_options.threads = value;
+            } else {
+                batch_options.max_in_flight = value;
+            }
+        } else {
+            args.push_back(std::move(arg));
+        }
+    }
+    size_t expected_args = validate_mode ? 1 : 2;
+    bool other_mode = validate_mode || index_mode || stream_mode;
+    if ((batch_mode || stream_mode ? args.size() < 2
+                                   : args.size() != expected_args) ||
+        (explain && (profile || batch_mode)) ||
+        ((explain || profile) && other_mode)) {
+        usage(argv[0]);
+        return 1;
+    }
+    json::schema_t schema;
+    if (!schema_path.empty()) {
+        try {
+            schema = load_schema(schema_path);
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        options.schema = &schema;
+    }
+    if (batch_mode) {
+        return run_batch(args, batch_options, profile);
+    }
+    if (other_mode) {
+        int status = validate_mode ? run_validate(args[0], options)
+                     : index_mode  ? run_indexed(args, options)
+                                   : run_stream(args, options);
+        if (show_stats) {
+            print_stats(std::cerr);
+        }
+        return status;
+    }
+
+    std::string text;
+    {
+        stats::timer timer(stats::Phase::READ);
+        std::ifstream json_stream(args[0], std::ios::binary);
+        if (!json_stream.is_open()) {
+            std::cerr << "Failed to open file: " << args[0] << std::endl;
+            return 1;
+        }
+        std::stringstream ss;
+        ss << json_stream.rdbuf();
+        text = std::move(ss).str();
+    }
+
+    std::ispanstream json_stream(text);
+    std::istringstream expr_stream(args[1]);
+
+    try {
+        auto decompressed = io::decompress(json_stream);
+        auto json = json::parse(decompressed ? *decompressed : json_stream,
+                                options);
+        auto expr = expr::parse(expr_stream);
+        if (explain || profile) {
+            // One evaluation is always measured; --explain reports it as
+            // output, --profile as a diagnostic like --stats.
+            expr::Profiled profiled(std::move(expr), 1);
+            print_result(profiled.node(), json.get());
+            profiled.explain(explain ? std::cout : std::cerr);
+        } else {
+            print_result(*expr, json.get());
         }
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
+
+    if (show_stats) {
+        print_stats(std::cerr);
+    }
 }
@@ -0,0 +1,146 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <profiled_expr.hpp>
+#include <stats.hpp>
+#include <type_traits>
+
+namespace expr {
+
+struct Profiled::record_t {
+    std::string label;
+    size_t depth;
+    std::atomic<size_t> evals{0};
+    // Totals over the measured evaluations.
+    std::atomic<size_t> measured{0};
+    std::atomic<size_t> ns{0};
+    std::atomic<size_t> lookups{0};
+    std::atomic<size_t> probes{0};
+    std::atomic<size_t> allocations{0};
+};
+
+namespace {
+
+// Evaluates the wrapped node, measuring one evaluation in `sample`.
+class ProfileNode : public tree::Node {
+  public:
+    ProfileNode(tree::ptr_t &&inner, Profiled::record_t &record,
+                size_t sample)
+        : Node(inner->ret_type), inner(std::move(inner)), record(record),
+          sample(sample) {}
+    std::string to_string(json::ref_t json) const override {
+        return measure([&] { return inner->to_string(json); });
+    }
+    result_t try_eval(json::ref_t json) const override {
+        return measure([&] { return inner->try_eval(json); });
+    }
+    result_t try_eval(json::ref_t json,
+                      const std::string &func) const override {
+        return measure([&] { return inner->try_eval(json, func); });
+    }
+    void for_each_slot(const std::function<void(tree::ptr_t &)> &visit)
+            override {
+        inner->for_each_slot(visit);
+    }
+    std::string label() const override { return inner->label(); }
+
+  protected:
+    // Unused: try_eval(json, func) forwards "size" to the wrapped node.
+    result_t size(json::ref_t json) const override {
+        return inner->try_eval(json, "size");
+    }
+
+  private:
+    template <typename Eval>
+    std::invoke_result_t<Eval> measure(Eval &&eval) const {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        size_t n = record.evals.fetch_add(1, relaxed);
+        if (n % sample != 0) {
+            return eval();
+        }
+        const stats::stats_t &counters = stats::current();
+        size_t lookups = counters.lookups, probes = counters.probes,
+               allocations = counters.allocations;
+        auto start = std::chrono::steady_clock::now();
+        auto result = eval();
+        auto end = std::chrono::steady_clock::now();
+        record.measured.fetch_add(1, relaxed);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start);
+        record.ns.fetch_add(ns.count(), relaxed);
+        record.lookups.fetch_add(counters.lookups - lookups, relaxed);
+        record.probes.fetch_add(counters.probes - probes, relaxed);
+        record.allocations.fetch_add(counters.allocations - allocations,
+                                     relaxed);
+        return result;
+    }
+
+    tree::ptr_t inner;
+    Profiled::record_t &record;
+    size_t sample;
+};
+
+} // namespace
+
+Profiled::Profiled(expr_t &&expr, size_t sample)
+    : expr(std::move(expr)), sample(sample ? sample : 1) {
+    instrument(this->expr, 0);
+}
+
+Profiled::~Profiled() = default;
+
+// Records the node before its children, so that records are in depth-first
+// order.
+void Profiled::instrument(tree::ptr_t &node, size_t depth) {
+    if (node->ret_type == RetType::STR) {
+        return;
+    }
+    auto record = std::make_unique<record_t>();
+    record->label = node->label();
+    record->depth = depth;
+    size_t at = records.size();
+    records.push_back(nullptr);
+    node->for_each_slot([this, depth](tree::ptr_t &child) {
+        instrument(child, depth + 1);
+    });
+    node = std::make_unique<ProfileNode>(std::move(node), *record, sample);
+    records[at] = std::move(record);
+}
+
+std::vector<Profiled::entry_t> Profiled::report() const {
+    std::vector<entry_t> entries;
+    entries.reserve(records.size());
+    for (const auto &record : records) {
+        counters_t counters;
+        counters.evals = record->evals.load();
+        if (size_t measured = record->measured.load()) {
+            double scale = static_cast<double>(counters.evals) / measured;
+            auto estimate = [scale](size_t total) {
+                return static_cast<size_t>(std::llround(total * scale));
+            };
+            counters.ms = record->ns.load() * scale / 1e6;
+            counters.lookups = estimate(record->lookups.load());
+            counters.probes = estimate(record->probes.load());
+            counters.allocations = estimate(record->allocations.load());
+        }
+        entries.push_back({record->label, record->depth, counters});
+    }
+    return entries;
+}
+
+void Profiled::explain(std::ostream &os) const {
+    os << std::right << std::setw(10) << "evals" << std::setw(12) << "time ms"
+       << std::setw(10) << "lookups" << std::setw(10) << "probes"
+       << std::setw(10) << "allocs"
+       << "  node\n";
+    for (const auto &[label, depth, counters] : report()) {
+        os << std::setw(10) << counters.evals << std::setw(12) << std::fixed
+           << std::setprecision(3) << counters.ms << std::setw(10)
+           << counters.lookups << std::setw(10) << counters.probes
+           << std::setw(10) << counters.allocations << "  "
+           << std::string(2 * depth, ' ') << label << "\n";
+    }
+}
+
+} // namespace expr
@@ -0,0 +1,55 @@
+#include <json_parser.hpp>
+
+namespace json {
+
+namespace {
+
+schema_t learn(ref_t sample) {
+    schema_t schema;
+    schema.type = sample->type;
+    if (sample->type == tree::Type::DICT) {
+        if (auto dict = dynamic_cast<const tree::DictNode *>(sample)) {
+            for (const auto &[key, value] : dict->entries()) {
+                schema.keys.push_back(key);
+                schema.values.push_back(learn(value.get()));
+            }
+        }
+    } else if (sample->type == tree::Type::LIST) {
+        schema.size = sample->size();
+        if (schema.size > 0) {
+            schema.values.push_back(learn(sample->at(0)));
+        }
+    }
+    return schema;
+}
+
+} // namespace
+
+schema_t infer(ref_t sample) {
+    schema_t schema = learn(sample);
+    compile(schema);
+    return schema;
+}
+
+void compile(schema_t &schema) {
+    for (auto &value : schema.values) {
+        compile(value);
+    }
+    schema.index = nullptr;
+    if (schema.type != tree::Type::DICT ||
+        schema.keys.size() <= tree::DictNode::linear_max) {
+        return;
+    }
+    auto index = std::make_shared<tree::index_t>();
+    index->keys = schema.keys;
+    index->slots.reserve(index->keys.size());
+    for (size_t i = 0; i < index->keys.size(); ++i) {
+        // Repeated keys would make dicts sharing the index ambiguous.
+        if (!index->slots.emplace(index->keys[i], i).second) {
+            return;
+        }
+    }
+    schema.index = std::move(index);
+}
+
+} // namespace json
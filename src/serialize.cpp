@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <serialize.hpp>
+#include <thread>
+#include <vector>
+
+namespace json {
+
+namespace {
+
+// A parsed dict or list, whose entries can be walked directly; other
+// containers (e.g. sidecar nodes) are written through to_string().
+struct container_t {
+    const tree::DictNode *dict = nullptr;
+    const tree::ListNode *list = nullptr;
+
+    explicit operator bool() const { return dict || list; }
+    size_t size() const {
+        return dict ? dict->entries().size() : list->elements().size();
+    }
+    ref_t child(size_t i) const {
+        return dict ? dict->entries()[i].second.get()
+                    : list->elements()[i].get();
+    }
+    char open() const { return dict ? '{' : '['; }
+    char close() const { return dict ? '}' : ']'; }
+};
+
+container_t container(ref_t node) {
+    if (node->type == tree::Type::DICT) {
+        return {dynamic_cast<const tree::DictNode *>(node), nullptr};
+    }
+    if (node->type == tree::Type::LIST) {
+        return {nullptr, dynamic_cast<const tree::ListNode *>(node)};
+    }
+    return {};
+}
+
+// Whether child `i` is a string printed in quotes: dict values are, list
+// elements and top level strings are not.
+bool quoted(container_t parent, size_t i) {
+    return parent.dict && parent.child(i)->type == tree::Type::STRING;
+}
+
+// The separator and key written before child `i`.
+void prefix(container_t parent, size_t i, std::string &out) {
+    if (i > 0) {
+        out += ", ";
+    }
+    if (parent.dict) {
+        out += '"';
+        out += parent.dict->entries()[i].first;
+        out += "\": ";
+    }
+}
+
+void leaf(ref_t node, bool quote, std::string &out) {
+    if (quote) {
+        out += '"';
+    }
+    node->print(out);
+    if (quote) {
+        out += '"';
+    }
+}
+
+// Writes children [begin, end) of `parent` with their separators, keeping
+// the open containers below it on a heap stack.
+void append_children(container_t parent, size_t begin, size_t end,
+                     std::string &out) {
+    struct frame_t {
+        container_t node;
+        size_t next, end;
+    };
+    std::vector<frame_t> stack{{parent, begin, end}};
+    while (!stack.empty()) {
+        frame_t &top = stack.back();
+        if (top.next == top.end) {
+            if (stack.size() > 1) {
+                out += top.node.close();
+            }
+            stack.pop_back();
+            continue;
+        }
+        size_t i = top.next++;
+        container_t node = top.node;
+        prefix(node, i, out);
+        ref_t child = node.child(i);
+        if (auto nested = container(child)) {
+            out += nested.open();
+            stack.push_back({nested, 0, nested.size()});
+        } else {
+            leaf(child, quoted(node, i), out);
+        }
+    }
+}
+
+size_t digits(int64_t value) {
+    size_t count = value < 0 ? 2 : 1;
+    uint64_t n = value < 0 ? -(uint64_t)value : value;
+    for (; n >= 10; n /= 10) {
+        ++count;
+    }
+    return count;
+}
+
+// A run of output: literal text, then optionally children [begin, end) of
+// a container.
+struct piece_t {
+    std::string text;
+    container_t parent;
+    size_t begin = 0, end = 0;
+    size_t size = 0;
+};
+
+// Splits `node` into pieces of at most about `chunk` bytes, descending into
+// children larger than that.
+void plan(container_t node, size_t chunk, std::vector<piece_t> &pieces) {
+    pieces.push_back({std::string(1, node.open()), {}, 0, 0, 1});
+    piece_t run{{}, node, 0, 0, 0};
+    for (size_t i = 0; i < node.size(); ++i) {
+        ref_t child = node.child(i);
+        size_t size = serialize::estimate(child) + (quoted(node, i) ? 2 : 0);
+        auto nested = container(child);
+        if (!nested || size <= chunk) {
+            run.end = i + 1;
+            run.size += size + 2;
+            if (node.dict) {
+                run.size += node.dict->entries()[i].first.size() + 4;
+            }
+            if (run.size >= chunk) {
+                pieces.push_back(std::move(run));
+                run = {{}, node, i + 1, i + 1, 0};
+            }
+            continue;
+        }
+        if (run.begin < run.end) {
+            pieces.push_back(std::move(run));
+        }
+        piece_t open{{}, {}, 0, 0, 0};
+        prefix(node, i, open.text);
+        open.size = open.text.size();
+        pieces.push_back(std::move(open));
+        plan(nested, chunk, pieces);
+        run = {{}, node, i + 1, i + 1, 0};
+    }
+    if (run.begin < run.end) {
+        pieces.push_back(std::move(run));
+    }
+    pieces.push_back({std::string(1, node.close()), {}, 0, 0, 1});
+}
+
+// Serializes `node` in chunks on worker threads, passing every chunk to
+// `ready` in order on the calling thread. Returns false if the value is
+// too small to be worth it, without calling `ready`.
+template <typename F>
+bool parallel(ref_t node, const serialize::options_t &options, F &&ready) {
+    size_t threads = options.threads ? options.threads
+                                     : std::thread::hardware_concurrency();
+    auto root = container(node);
+    if (threads <= 1 || !root) {
+        return false;
+    }
+    size_t total = serialize::estimate(node);
+    if (total < options.min_parallel) {
+        return false;
+    }
+
+    // A few chunks per thread even out children of uneven size.
+    size_t chunk = std::max<size_t>(total / (threads * 4), 1);
+    std::vector<piece_t> pieces;
+    plan(root, chunk, pieces);
+    std::vector<std::pair<size_t, size_t>> chunks;
+    for (size_t begin = 0, size = 0, i = 0; i < pieces.size(); ++i) {
+        size += pieces[i].size;
+        if (size >= chunk || i + 1 == pieces.size()) {
+            chunks.emplace_back(begin, i + 1);
+            begin = i + 1;
+            size = 0;
+        }
+    }
+
+    std::vector<std::string> buffers(chunks.size());
+    std::vector<char> done(chunks.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next = 0;
+    auto work = [&] {
+        while (true) {
+            size_t i;
+            {
+                std::lock_guard lock(mutex);
+                if (next == chunks.size()) {
+                    return;
+                }
+                i = next++;
+            }
+            std::string buffer;
+            size_t size = 0;
+            for (size_t j = chunks[i].first; j < chunks[i].second; ++j) {
+                size += pieces[j].size;
+            }
+            buffer.reserve(size);
+            for (size_t j = chunks[i].first; j < chunks[i].second; ++j) {
+                const piece_t &piece = pieces[j];
+                buffer += piece.text;
+                if (piece.begin < piece.end) {
+                    append_children(piece.parent, piece.begin, piece.end,
+                                    buffer);
+                }
+            }
+            {
+                std::lock_guard lock(mutex);
+                buffers[i] = std::move(buffer);
+                done[i] = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    // Joined before the buffers go away, even if `ready` throws.
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i < std::min(threads, chunks.size()); ++i) {
+        workers.emplace_back(work);
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        std::string buffer;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [&] { return done[i] != 0; });
+            buffer = std::move(buffers[i]);
+        }
+        ready(buffer);
+    }
+    return true;
+}
+
+} // namespace
+
+void tree::append(ref_t node, std::string &out) {
+    auto root = container(node);
+    if (!root) {
+        node->print(out);
+        return;
+    }
+    out += root.open();
+    append_children(root, 0, root.size(), out);
+    out += root.close();
+}
+
+size_t serialize::estimate(ref_t node) {
+    size_t total = 0;
+    std::vector<ref_t> stack{node};
+    while (!stack.empty()) {
+        ref_t current = stack.back();
+        stack.pop_back();
+        switch (current->type) {
+        case tree::Type::INT:
+            total += digits(current->to_int());
+            continue;
+        case tree::Type::STRING:
+            total += current->size();
+            continue;
+        default:
+            break;
+        }
+        auto nested = container(current);
+        if (!nested) {
+            total += current->size();
+            continue;
+        }
+        size_t count = nested.size();
+        total += 2 + (count > 0 ? 2 * (count - 1) : 0);
+        for (size_t i = 0; i < count; ++i) {
+            if (nested.dict) {
+                total += nested.dict->entries()[i].first.size() + 4;
+                total += quoted(nested, i) ? 2 : 0;
+            }
+            stack.push_back(nested.child(i));
+        }
+    }
+    return total;
+}
+
+std::string serialize::to_string(ref_t node, const options_t &options) {
+    std::string out;
+    std::vector<std::string> chunks;
+    size_t size = 0;
+    bool split = parallel(node, options, [&](std::string &chunk) {
+        size += chunk.size();
+        chunks.push_back(std::move(chunk));
+    });
+    if (!split) {
+        tree::append(node, out);
+        return out;
+    }
+    out.reserve(size);
+    for (const auto &chunk : chunks) {
+        out += chunk;
+    }
+    return out;
+}
+
+void serialize::write(std::ostream &os, ref_t node, const options_t &options) {
+    bool split = parallel(node, options, [&os](const std::string &chunk) {
+        os.write(chunk.data(), chunk.size());
+    });
+    if (!split) {
+        std::string out;
+        tree::append(node, out);
+        os << out;
+    }
+}
+
+} // namespace json
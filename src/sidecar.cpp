@@ -0,0 +1,920 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sidecar.hpp>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace json::sidecar {
+
+namespace {
+
+constexpr char magic[8] = {'J', 'S', 'O', 'N', 'I', 'D', 'X', '3'};
+// Bytes hashed at each end of the file for staleness checks.
+constexpr size_t hash_span = 64 << 10;
+
+struct header_t {
+    char magic[8];
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+    uint64_t nodes;
+    uint64_t slots;
+};
+
+// One value, in document order; the root is node 0.
+struct node_t {
+    // Byte range of the value in the file.
+    uint64_t begin;
+    uint64_t end;
+    // The children of a dict or list are slots [first, first + count).
+    uint64_t first;
+    uint64_t count;
+    uint32_t type;
+    uint32_t unused;
+};
+
+// A child of a dict or list. For dicts, the key's bytes between the quotes
+// and a hash of the key as the parser reads it.
+struct slot_t {
+    uint64_t node;
+    uint64_t key_begin;
+    uint32_t key_length;
+    uint32_t key_hash;
+};
+
+// FNV-1a, skipping whitespace like parser::Parser does.
+uint32_t key_hash(std::string_view key) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : key) {
+        if (!std::isspace(c)) {
+            hash = (hash ^ c) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// The parser drops whitespace everywhere, including inside strings.
+std::string decode(std::string_view raw) {
+    std::string result;
+    result.reserve(raw.size());
+    for (unsigned char c : raw) {
+        if (!std::isspace(c)) {
+            result.push_back(c);
+        }
+    }
+    return result;
+}
+
+int64_t decode_int(std::string_view raw) {
+    int64_t result = 0;
+    for (char c : raw) {
+        if (std::isdigit(static_cast<unsigned char>(c)) &&
+            !push_digit(result, c)) {
+            error::raise({error::Code::INTEGER_RANGE});
+        }
+    }
+    return result;
+}
+
+// A read-only mapping of a whole file.
+class mapping_t {
+  public:
+    explicit mapping_t(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("INDEX: Failed to open file: " + path);
+        }
+        if (fstat(fd, &st) < 0) {
+            ::close(fd);
+            throw std::runtime_error("INDEX: Failed to stat file: " + path);
+        }
+        size = st.st_size;
+        if (size > 0) {
+            void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("INDEX: Failed to map file: " +
+                                         path);
+            }
+            data = static_cast<const char *>(p);
+        }
+        ::close(fd);
+    }
+    mapping_t(const mapping_t &) = delete;
+    mapping_t &operator=(const mapping_t &) = delete;
+    ~mapping_t() {
+        if (data) {
+            munmap(const_cast<char *>(data), size);
+        }
+    }
+
+    void advise(int advice) const {
+        if (data) {
+            madvise(const_cast<char *>(data), size, advice);
+        }
+    }
+    std::string_view view(uint64_t begin, uint64_t end) const {
+        return {data + begin, end - begin};
+    }
+    int64_t mtime() const {
+        return st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    }
+    uint64_t hash() const {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](std::string_view bytes) {
+            for (unsigned char c : bytes) {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+        };
+        mix(view(0, std::min<size_t>(size, hash_span)));
+        if (size > hash_span) {
+            mix(view(std::max(size - hash_span, hash_span), size));
+        }
+        return hash;
+    }
+
+    const char *data = nullptr;
+    size_t size = 0;
+
+  private:
+    struct stat st;
+};
+
+// A file written through a buffer. Records may be read back and rewritten
+// in place, also once they have been flushed.
+class file_t {
+  public:
+    file_t(int fd, std::string name) : fd(fd), name(std::move(name)) {
+        buffer.reserve(buffer_size);
+    }
+    file_t(const file_t &) = delete;
+    file_t &operator=(const file_t &) = delete;
+    ~file_t() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // A file next to `path` that is removed once closed.
+    static std::unique_ptr<file_t> scratch(const std::string &path) {
+        std::string name = path + ".XXXXXX";
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            throw std::runtime_error("INDEX: Failed to create file: " + name);
+        }
+        ::unlink(name.c_str());
+        return std::make_unique<file_t>(fd, name);
+    }
+
+    void append(const void *data, size_t n) {
+        if (buffer.size() + n > buffer_size) {
+            flush();
+        }
+        auto bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + n);
+    }
+    void write_at(uint64_t offset, const void *data, size_t n) {
+        if (offset < flushed && offset + n > flushed) {
+            flush();
+        }
+        if (offset >= flushed) {
+            std::memcpy(buffer.data() + (offset - flushed), data, n);
+        } else if (pwrite(fd, data, n, offset) != (ssize_t)n) {
+            fail();
+        }
+    }
+    void read_at(uint64_t offset, void *data, size_t n) {
+        if (offset < flushed && offset + n > flushed) {
+            flush();
+        }
+        if (offset >= flushed) {
+            std::memcpy(data, buffer.data() + (offset - flushed), n);
+        } else if (pread(fd, data, n, offset) != (ssize_t)n) {
+            fail();
+        }
+    }
+    // Appends the first `n` bytes of `from`.
+    void copy(file_t &from, uint64_t n) {
+        from.flush();
+        std::vector<char> chunk(buffer_size);
+        for (uint64_t done = 0; done < n;) {
+            size_t length = std::min<uint64_t>(n - done, chunk.size());
+            from.read_at(done, chunk.data(), length);
+            append(chunk.data(), length);
+            done += length;
+        }
+    }
+    void flush() {
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t n = pwrite(fd, buffer.data() + done, buffer.size() - done,
+                               flushed + done);
+            if (n <= 0) {
+                fail();
+            }
+            done += n;
+        }
+        flushed += buffer.size();
+        buffer.clear();
+    }
+    // Empties the file for reuse.
+    void clear() {
+        buffer.clear();
+        flushed = 0;
+    }
+    uint64_t size() const { return flushed + buffer.size(); }
+
+  private:
+    static constexpr size_t buffer_size = 1 << 16;
+
+    [[noreturn]] void fail() {
+        throw std::runtime_error("INDEX: Failed to write index: " + name);
+    }
+
+    int fd;
+    std::string name;
+    std::vector<char> buffer;
+    // Bytes written to the file; the buffer holds those after them.
+    uint64_t flushed = 0;
+};
+
+// Scans a document with the grammar of json::parse, writing a record for
+// every value as it goes: slots to `out` as their container closes, nodes
+// to `nodes` in document order. Like json_parser it keeps open containers
+// on a heap stack; a container's slots stay in memory up to a chunk and
+// are spilled to a scratch file per depth beyond that, so memory depends
+// on the nesting depth rather than on the size of the document. Dicts with
+// more than eight keys also keep a hash per key to drop repeated ones.
+class indexer {
+  public:
+    indexer(const mapping_t &source, const options_t &options, file_t &out,
+            file_t &nodes, const std::string &path)
+        : p(source.data), begin(source.data), end(source.data + source.size),
+          options(options), out(out), nodes(nodes), path(path) {}
+
+    void run() {
+        whitespace();
+        while (true) {
+            uint64_t id;
+            if (next() == '{' || next() == '[') {
+                bool dict = next() == '{';
+                open(dict ? tree::Type::DICT : tree::Type::LIST);
+                if (next() != (dict ? '}' : ']')) {
+                    if (dict) {
+                        key();
+                    }
+                    continue;
+                }
+                id = close();
+            } else {
+                id = value();
+            }
+
+            // Hand the finished value to the enclosing containers, closing
+            // every one that ends here.
+            while (!stack.empty()) {
+                add(id);
+                frame_t &top = stack.back();
+                if (next() == ',') {
+                    advance();
+                    if (top.type == tree::Type::DICT) {
+                        key();
+                    }
+                    break;
+                }
+                id = close();
+            }
+            if (stack.empty()) {
+                if (p != end) {
+                    fail(error::Code::JSON_EOF_EXPECTED);
+                }
+                return;
+            }
+        }
+    }
+
+    uint64_t node_count = 0;
+    uint64_t slot_count = 0;
+
+  private:
+    // Slots held in memory per open container before it spills.
+    static constexpr size_t chunk = 4096;
+    static constexpr size_t linear_max = 8;
+
+    struct frame_t {
+        tree::Type type;
+        uint64_t node;
+        uint64_t begin;
+        // Children so far: the first `spilled` in the scratch file of this
+        // depth, the rest in `children`.
+        uint64_t count = 0;
+        uint64_t spilled = 0;
+        std::vector<slot_t> children;
+        // Child positions by key hash, once a dict has more than
+        // linear_max keys, to keep repeated keys at their first position.
+        // This is the one part of the indexer's memory that grows with the
+        // data, by about 32 bytes per key of the open dicts.
+        std::unordered_multimap<uint32_t, uint64_t> keys;
+        slot_t key;
+    };
+
+    uint64_t record(const node_t &node) {
+        nodes.append(&node, sizeof(node));
+        return node_count++;
+    }
+
+    void open(tree::Type type) {
+        if (stack.size() >= options.max_depth) {
+            fail(error::Code::MAX_DEPTH);
+        }
+        // Written now to keep document order, completed by close().
+        uint64_t id = record({offset(), 0, 0, 0, static_cast<uint32_t>(type)});
+        stack.push_back({type, id, offset()});
+        advance();
+    }
+
+    uint64_t close() {
+        frame_t &top = stack.back();
+        node_t node{top.begin, offset() + 1, slot_count, top.count,
+                    static_cast<uint32_t>(top.type)};
+        expect(top.type == tree::Type::DICT ? '}' : ']');
+        if (top.spilled > 0) {
+            file_t &spill = *spills[stack.size() - 1];
+            out.copy(spill, top.spilled * sizeof(slot_t));
+            spill.clear();
+        }
+        out.append(top.children.data(), top.children.size() * sizeof(slot_t));
+        slot_count += top.count;
+        nodes.write_at(top.node * sizeof(node_t), &node, sizeof(node));
+        uint64_t id = top.node;
+        stack.pop_back();
+        return id;
+    }
+
+    // Adds value `id` to the innermost container. A repeated dict key keeps
+    // its first position and takes the last value, like tree::DictNode.
+    void add(uint64_t id) {
+        frame_t &top = stack.back();
+        top.key.node = id;
+        if (top.type == tree::Type::DICT) {
+            uint64_t at = find(top);
+            if (at != npos) {
+                slot_t slot = get(top, at);
+                slot.node = id;
+                set(top, at, slot);
+                return;
+            }
+            if (top.count == linear_max) {
+                for (uint64_t i = 0; i < top.count; ++i) {
+                    top.keys.emplace(top.children[i].key_hash, i);
+                }
+            }
+            if (top.count >= linear_max) {
+                top.keys.emplace(top.key.key_hash, top.count);
+            }
+        }
+        top.children.push_back(top.key);
+        ++top.count;
+        if (top.children.size() == chunk) {
+            spill(top);
+        }
+    }
+
+    // Position of the frame's pending key among its children, or npos.
+    uint64_t find(frame_t &top) {
+        const slot_t &key = top.key;
+        if (top.count <= linear_max) {
+            for (uint64_t i = 0; i < top.count; ++i) {
+                if (same_key(top.children[i], key)) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+        auto [first, last] = top.keys.equal_range(key.key_hash);
+        for (auto it = first; it != last; ++it) {
+            if (same_key(get(top, it->second), key)) {
+                return it->second;
+            }
+        }
+        return npos;
+    }
+
+    bool same_key(const slot_t &a, const slot_t &b) const {
+        if (a.key_hash != b.key_hash) {
+            return false;
+        }
+        std::string_view x{begin + a.key_begin, a.key_length},
+                y{begin + b.key_begin, b.key_length};
+        return x == y || decode(x) == decode(y);
+    }
+
+    slot_t get(frame_t &top, uint64_t i) {
+        if (i >= top.spilled) {
+            return top.children[i - top.spilled];
+        }
+        slot_t slot;
+        spills[stack.size() - 1]->read_at(i * sizeof(slot_t), &slot,
+                                          sizeof(slot));
+        return slot;
+    }
+
+    void set(frame_t &top, uint64_t i, const slot_t &slot) {
+        if (i >= top.spilled) {
+            top.children[i - top.spilled] = slot;
+            return;
+        }
+        spills[stack.size() - 1]->write_at(i * sizeof(slot_t), &slot,
+                                           sizeof(slot));
+    }
+
+    void spill(frame_t &top) {
+        size_t depth = stack.size() - 1;
+        if (spills.size() <= depth) {
+            spills.resize(depth + 1);
+        }
+        if (!spills[depth]) {
+            spills[depth] = file_t::scratch(path);
+        }
+        spills[depth]->append(top.children.data(),
+                              top.children.size() * sizeof(slot_t));
+        top.spilled += top.children.size();
+        top.children.clear();
+    }
+
+    void key() {
+        auto [first, last] = string();
+        slot_t &key = stack.back().key;
+        key.key_begin = first + 1;
+        key.key_length = last - first - 2;
+        key.key_hash = key_hash({begin + key.key_begin, key.key_length});
+        expect(':');
+    }
+
+    uint64_t value() {
+        if (next() == '"') {
+            auto [first, last] = string();
+            return record({first, last, 0, 0,
+                           static_cast<uint32_t>(tree::Type::STRING)});
+        }
+        if (std::isdigit(static_cast<unsigned char>(next()))) {
+            uint64_t first = offset(), last = offset();
+            while (p != end && std::isdigit(static_cast<unsigned char>(*p))) {
+                last = offset();
+                advance();
+            }
+            return record({first, last + 1, 0, 0,
+                           static_cast<uint32_t>(tree::Type::INT)});
+        }
+        fail(error::Code::UNEXPECTED_CHAR);
+    }
+
+    // The byte range of a string, quotes included.
+    std::pair<uint64_t, uint64_t> string() {
+        uint64_t start = offset();
+        expect('"');
+        const char *close =
+                static_cast<const char *>(std::memchr(p, '"', end - p));
+        if (!close) {
+            p = end;
+            fail(error::Code::UNEXPECTED_EOF);
+        }
+        p = close;
+        uint64_t stop = offset() + 1;
+        advance();
+        return {start, stop};
+    }
+
+    char next() {
+        if (p == end) {
+            fail(error::Code::UNEXPECTED_EOF);
+        }
+        return *p;
+    }
+    void expect(char c) {
+        if (p == end || *p != c) {
+            fail(error::Code::EXPECTED_CHAR, c);
+        }
+        advance();
+    }
+    void advance() {
+        ++p;
+        whitespace();
+    }
+    void whitespace() {
+        while (p != end && std::isspace(static_cast<unsigned char>(*p))) {
+            ++p;
+        }
+    }
+    uint64_t offset() const { return p - begin; }
+    [[noreturn]] void fail(error::Code code, char expected = 0) {
+        error::raise({code, expected, offset()});
+    }
+
+    static constexpr uint64_t npos = -1;
+
+    const char *p, *begin, *end;
+    const options_t &options;
+    file_t &out, &nodes;
+    const std::string &path;
+    std::vector<frame_t> stack;
+    // Scratch files for slots of large containers, by depth.
+    std::vector<std::unique_ptr<file_t>> spills;
+};
+
+class lazy_document;
+
+// A node decoded from the mapped file on demand.
+class LazyNode : public tree::Node {
+  public:
+    LazyNode(const lazy_document &doc, uint64_t id, tree::Type type)
+        : Node(type), doc(doc), id(id) {}
+    std::string to_string() const override;
+    int64_t to_int() const override;
+    size_t size() const override;
+    void collect(std::vector<ref_t> &out) const override;
+    error::result_t<ref_t> try_at(int index) const override;
+    error::result_t<ref_t> try_at(const std::string &key) const override;
+    size_t slot(std::string_view key) const override;
+    ref_t at_slot(size_t slot, std::string_view key) const override;
+    const tree::column_t *column() const override;
+    const tree::column_t *column(const std::string &key) const override;
+
+  private:
+    const lazy_document &doc;
+    uint64_t id;
+    // Columns built so far, like tree::ListNode's.
+    mutable bool built = false;
+    mutable std::unique_ptr<tree::column_t> self;
+    mutable std::unordered_map<std::string, std::unique_ptr<tree::column_t>>
+            fields;
+};
+
+class lazy_document : public Document {
+  public:
+    lazy_document(std::unique_ptr<mapping_t> source,
+                  std::unique_ptr<mapping_t> index)
+        : source(std::move(source)), index(std::move(index)) {
+        auto header = reinterpret_cast<const header_t *>(this->index->data);
+        slots = reinterpret_cast<const slot_t *>(header + 1);
+        nodes = reinterpret_cast<const node_t *>(slots + header->slots);
+        // Queries jump around the file.
+        this->source->advise(MADV_RANDOM);
+    }
+
+    // Starts a query: the nodes created for earlier ones are released.
+    ref_t root() const override {
+        cache.clear();
+        return node(0);
+    }
+
+    ref_t node(uint64_t id) const {
+        auto &node = cache[id];
+        if (!node) {
+            auto type = static_cast<tree::Type>(nodes[id].type);
+            node = std::make_unique<LazyNode>(*this, id, type);
+        }
+        return node.get();
+    }
+
+    const node_t &entry(uint64_t id) const { return nodes[id]; }
+    const slot_t &child(uint64_t id, size_t i) const {
+        return slots[nodes[id].first + i];
+    }
+    std::string_view text(uint64_t id) const {
+        return source->view(nodes[id].begin, nodes[id].end);
+    }
+    std::string_view key(const slot_t &slot) const {
+        return source->view(slot.key_begin, slot.key_begin + slot.key_length);
+    }
+    bool key_equals(const slot_t &slot, std::string_view key) const {
+        std::string_view raw = this->key(slot);
+        if (raw == key) {
+            return true;
+        }
+        return raw.size() > key.size() && decode(raw) == key;
+    }
+    // Slot of `key` in dict `id`, trying `hint` first; npos if missing.
+    size_t find(uint64_t id, std::string_view key, size_t hint) const {
+        const node_t &node = nodes[id];
+        if (hint < node.count && key_equals(child(id, hint), key)) {
+            return hint;
+        }
+        uint32_t hash = key_hash(key);
+        for (size_t i = 0; i < node.count; ++i) {
+            const slot_t &slot = child(id, i);
+            if (slot.key_hash == hash && key_equals(slot, key)) {
+                return i;
+            }
+        }
+        return tree::Node::npos;
+    }
+
+    // The ints of list `id`, or of field `key` of its dicts, read straight
+    // from the index; nullptr unless all of them are ints.
+    std::unique_ptr<tree::column_t> column(uint64_t id,
+                                           const std::string *key) const {
+        const uint32_t int_type = static_cast<uint32_t>(tree::Type::INT);
+        const uint32_t dict_type = static_cast<uint32_t>(tree::Type::DICT);
+        auto column = std::make_unique<tree::column_t>();
+        column->reserve(nodes[id].count);
+        size_t hint = tree::Node::npos;
+        for (size_t i = 0; i < nodes[id].count; ++i) {
+            uint64_t elem = child(id, i).node;
+            if (key) {
+                if (nodes[elem].type != dict_type) {
+                    return nullptr;
+                }
+                hint = find(elem, *key, hint);
+                if (hint == tree::Node::npos) {
+                    return nullptr;
+                }
+                elem = child(elem, hint).node;
+            }
+            if (nodes[elem].type != int_type) {
+                return nullptr;
+            }
+            column->push_back(decode_int(text(elem)));
+        }
+        return column;
+    }
+
+    // Dicts print their string values in quotes.
+    bool quoted(const slot_t &slot) const {
+        return nodes[slot.node].type ==
+               static_cast<uint32_t>(tree::Type::STRING);
+    }
+
+    std::string string(uint64_t id) const {
+        std::string_view raw = text(id);
+        return decode(raw.substr(1, raw.size() - 2));
+    }
+
+    // Prints like the tree nodes do, straight from the file. Dicts and
+    // lists are walked without recursion, like tree::append.
+    void format(uint64_t id, std::string &out) const {
+        struct open_t {
+            uint64_t id;
+            size_t next;
+        };
+        std::vector<open_t> stack;
+        while (true) {
+            const node_t &node = nodes[id];
+            switch (static_cast<tree::Type>(node.type)) {
+            case tree::Type::INT:
+                out += std::to_string(decode_int(text(id)));
+                break;
+            case tree::Type::STRING:
+                out += string(id);
+                break;
+            case tree::Type::DICT:
+                out += "{";
+                stack.push_back({id, 0});
+                break;
+            case tree::Type::LIST:
+                out += "[";
+                stack.push_back({id, 0});
+                break;
+            }
+            // Close the values that are done and find the next child.
+            while (!stack.empty()) {
+                open_t &top = stack.back();
+                const node_t &parent = nodes[top.id];
+                bool dict = parent.type ==
+                            static_cast<uint32_t>(tree::Type::DICT);
+                if (dict && top.next > 0 &&
+                    quoted(child(top.id, top.next - 1))) {
+                    out += "\"";
+                }
+                if (top.next == parent.count) {
+                    out += dict ? "}" : "]";
+                    stack.pop_back();
+                    continue;
+                }
+                if (top.next > 0) {
+                    out += ", ";
+                }
+                const slot_t &slot = child(top.id, top.next++);
+                if (dict) {
+                    out += '"';
+                    out += decode(key(slot));
+                    out += "\": ";
+                    if (quoted(slot)) {
+                        out += "\"";
+                    }
+                }
+                id = slot.node;
+                break;
+            }
+            if (stack.empty()) {
+                return;
+            }
+        }
+    }
+
+  private:
+    std::unique_ptr<mapping_t> source, index;
+    const node_t *nodes;
+    const slot_t *slots;
+    mutable std::unordered_map<uint64_t, std::unique_ptr<LazyNode>> cache;
+};
+
+std::string LazyNode::to_string() const {
+    std::string out;
+    doc.format(id, out);
+    return out;
+}
+
+int64_t LazyNode::to_int() const {
+    if (type != tree::Type::INT) {
+        throw std::runtime_error((std::string) "JSON: " +
+                                 tree::type_name(type) +
+                                 " can not be converted to int");
+    }
+    return decode_int(doc.text(id));
+}
+
+size_t LazyNode::size() const {
+    switch (type) {
+    case tree::Type::INT:
+        return 1;
+    case tree::Type::STRING:
+        return doc.string(id).size();
+    default:
+        return doc.entry(id).count;
+    }
+}
+
+void LazyNode::collect(std::vector<ref_t> &out) const {
+    if (type != tree::Type::DICT && type != tree::Type::LIST) {
+        out.push_back(this);
+        return;
+    }
+    out.reserve(out.size() + doc.entry(id).count);
+    for (size_t i = 0; i < doc.entry(id).count; ++i) {
+        out.push_back(doc.node(doc.child(id, i).node));
+    }
+}
+
+error::result_t<ref_t> LazyNode::try_at(int index) const {
+    if (type != tree::Type::LIST) {
+        return Node::try_at(index);
+    }
+    if (index >= 0 && (size_t)index < doc.entry(id).count) {
+        return doc.node(doc.child(id, index).node);
+    }
+    return std::unexpected(error::error_t{error::Code::INDEX_OUT_OF_RANGE});
+}
+
+error::result_t<ref_t> LazyNode::try_at(const std::string &key) const {
+    if (type != tree::Type::DICT) {
+        return Node::try_at(key);
+    }
+    size_t i = slot(key);
+    if (i == npos) {
+        return std::unexpected(
+                error::error_t{error::Code::KEY_NOT_FOUND, 0, 0, key});
+    }
+    return doc.node(doc.child(id, i).node);
+}
+
+size_t LazyNode::slot(std::string_view key) const {
+    if (type != tree::Type::DICT) {
+        return npos;
+    }
+    return doc.find(id, key, npos);
+}
+
+ref_t LazyNode::at_slot(size_t slot, std::string_view key) const {
+    if (type != tree::Type::DICT || slot >= doc.entry(id).count ||
+        !doc.key_equals(doc.child(id, slot), key)) {
+        return nullptr;
+    }
+    return doc.node(doc.child(id, slot).node);
+}
+
+const tree::column_t *LazyNode::column() const {
+    if (type != tree::Type::LIST) {
+        return nullptr;
+    }
+    if (!built) {
+        self = doc.column(id, nullptr);
+        built = true;
+    }
+    return self.get();
+}
+
+const tree::column_t *LazyNode::column(const std::string &key) const {
+    if (type != tree::Type::LIST) {
+        return nullptr;
+    }
+    auto it = fields.find(key);
+    if (it == fields.end()) {
+        it = fields.emplace(key, doc.column(id, &key)).first;
+    }
+    return it->second.get();
+}
+
+bool compressed(const mapping_t &source) {
+    auto bytes = reinterpret_cast<const unsigned char *>(source.data);
+    return source.size >= 2 &&
+           ((bytes[0] == 0x1f && bytes[1] == 0x8b) ||
+            (source.size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 &&
+             bytes[2] == 0x2f && bytes[3] == 0xfd));
+}
+
+} // namespace
+
+std::string index_path(const std::string &path) { return path + ".idx"; }
+
+void build(const std::string &path, const options_t &options) {
+    mapping_t source(path);
+    if (compressed(source)) {
+        throw std::runtime_error(
+                "INDEX: Compressed files can not be indexed: " + path);
+    }
+    source.advise(MADV_SEQUENTIAL);
+
+    // Write a temporary file and rename it, so readers never see a partial
+    // index. Slots go straight to it after room for the header; nodes,
+    // which are completed out of order, go to a scratch file first.
+    std::string target = index_path(path);
+    std::string tmp = target + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("INDEX: Failed to write index: " + tmp);
+    }
+    header_t header;
+    try {
+        file_t out(fd, tmp);
+        auto nodes = file_t::scratch(tmp);
+        std::memset(&header, 0, sizeof(header));
+        out.append(&header, sizeof(header));
+        indexer scan(source, options, out, *nodes, tmp);
+        scan.run();
+
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.size = source.size;
+        header.mtime = source.mtime();
+        header.hash = source.hash();
+        header.nodes = scan.node_count;
+        header.slots = scan.slot_count;
+        out.copy(*nodes, scan.node_count * sizeof(node_t));
+        out.write_at(0, &header, sizeof(header));
+        out.flush();
+    } catch (...) {
+        std::remove(tmp.c_str());
+        throw;
+    }
+    if (std::rename(tmp.c_str(), target.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("INDEX: Failed to write index: " + target);
+    }
+}
+
+std::unique_ptr<Document> open(const std::string &path) {
+    auto source = std::make_unique<mapping_t>(path);
+    std::unique_ptr<mapping_t> index;
+    try {
+        index = std::make_unique<mapping_t>(index_path(path));
+    } catch (const std::exception &) {
+        return nullptr;
+    }
+    if (index->size < sizeof(header_t)) {
+        return nullptr;
+    }
+    auto header = reinterpret_cast<const header_t *>(index->data);
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        header->size != source->size || header->mtime != source->mtime() ||
+        header->hash != source->hash() || header->nodes == 0 ||
+        index->size != sizeof(header_t) + header->nodes * sizeof(node_t) +
+                               header->slots * sizeof(slot_t)) {
+        return nullptr;
+    }
+    return std::make_unique<lazy_document>(std::move(source),
+                                           std::move(index));
+}
+
+std::unique_ptr<Document> load(const std::string &path,
+                               const options_t &options) {
+    if (auto doc = open(path)) {
+        return doc;
+    }
+    build(path, options);
+    if (auto doc = open(path)) {
+        return doc;
+    }
+    throw std::runtime_error("INDEX: File changed while indexing: " + path);
+}
+
+} // namespace json::sidecar
@@ -0,0 +1,627 @@
+#include <algorithm>
+#include <batch.hpp>
+#include <optional>
+#include <parser.hpp>
+#include <stats.hpp>
+#include <stream.hpp>
+#include <unordered_map>
+
+namespace stream {
+
+namespace {
+
+constexpr size_t none = -1;
+
+// One state of the path automaton, reached by a path prefix.
+struct state_t {
+    // A path ends here, so the whole value is kept.
+    bool terminal = false;
+    // A path that is only aggregated over (min, max or size) ends here.
+    bool fold = false;
+    std::unordered_map<std::string, size_t> keys;
+    std::unordered_map<int, size_t> indices;
+    // Computed indices, which may pick any element of a list.
+    size_t any = none;
+};
+
+// A trie over the paths of all JsonNodes in the expressions, including
+// those used as computed indices. State 0 is the document root.
+class automaton_t {
+  public:
+    automaton_t() : states(1) {}
+
+    // Adds the paths of `expr`; `aggregated` when it is an argument of
+    // min, max or size.
+    void add(expr::tree::Node &expr, bool aggregated = false) {
+        if (expr.ret_type == expr::RetType::JSON) {
+            size_t state = 0;
+            for (const auto &step :
+                 static_cast<expr::tree::JsonNode &>(expr).path()) {
+                state = next(state, *step);
+            }
+            (aggregated ? states[state].fold : states[state].terminal) = true;
+        }
+        auto function = dynamic_cast<expr::tree::FunctionNode *>(&expr);
+        bool aggregate = function && (function->name() == "min" ||
+                                      function->name() == "max" ||
+                                      function->name() == "size");
+        expr.for_each_child([this, aggregate](expr::tree::Node &child) {
+            add(child, aggregate);
+        });
+    }
+
+    // Whether a list at `state` can be folded while it is read: nothing
+    // needs its elements but aggregates over it and over fields of its
+    // elements, as in min(a.b.c).
+    bool foldable(size_t state) const {
+        const state_t &s = states[state];
+        if (s.terminal || !s.indices.empty() || s.any != none ||
+            (!s.fold && s.keys.empty())) {
+            return false;
+        }
+        for (const auto &[key, to] : s.keys) {
+            const state_t &field = states[to];
+            if (field.terminal || !field.keys.empty() ||
+                !field.indices.empty() || field.any != none) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<state_t> states;
+
+  private:
+    size_t next(size_t from, expr::tree::Node &step) {
+        if (step.ret_type == expr::RetType::STR) {
+            std::string key = step.to_string(nullptr);
+            auto it = states[from].keys.find(key);
+            if (it != states[from].keys.end()) {
+                return it->second;
+            }
+            size_t to = add_state();
+            states[from].keys.emplace(std::move(key), to);
+            return to;
+        }
+        if (auto index = constant(step)) {
+            auto it = states[from].indices.find(*index);
+            if (it != states[from].indices.end()) {
+                return it->second;
+            }
+            size_t to = add_state();
+            states[from].indices.emplace(*index, to);
+            return to;
+        }
+        if (states[from].any == none) {
+            size_t to = add_state();
+            states[from].any = to;
+        }
+        return states[from].any;
+    }
+
+    size_t add_state() {
+        states.emplace_back();
+        return states.size() - 1;
+    }
+
+    // The value of an index that does not depend on the document. Indices
+    // out of int range are left to evaluation, which reports them.
+    static std::optional<int> constant(expr::tree::Node &step) {
+        if (step.ret_type != expr::RetType::INT || reads_json(step)) {
+            return std::nullopt;
+        }
+        auto value = step.try_eval(nullptr);
+        if (!value) {
+            return std::nullopt;
+        }
+        auto index = expr::to_index(*value);
+        if (!index) {
+            return std::nullopt;
+        }
+        return *index;
+    }
+
+    static bool reads_json(expr::tree::Node &node) {
+        bool found = node.ret_type == expr::RetType::JSON;
+        node.for_each_child([&found](expr::tree::Node &child) {
+            found = found || reads_json(child);
+        });
+        return found;
+    }
+};
+
+// A list holding only the elements at some indices, for paths that pick
+// single elements.
+class SparseList : public json::tree::Node {
+  public:
+    using entries_t = std::vector<std::pair<size_t, json::json_t>>;
+
+    SparseList(size_t count, entries_t &&entries)
+        : Node(json::tree::Type::LIST), count(count),
+          entries(std::move(entries)) {}
+    std::string to_string() const override {
+        std::string result = "[";
+        for (const auto &[index, value] : entries) {
+            if (result.size() > 1) {
+                result += ", ";
+            }
+            result += value->to_string();
+        }
+        return result + "]";
+    }
+    int64_t to_int() const override {
+        throw std::runtime_error("JSON: List can not be converted to int");
+    }
+    size_t size() const override { return count; }
+    void collect(std::vector<json::ref_t> &out) const override {
+        out.reserve(out.size() + entries.size());
+        for (const auto &[index, value] : entries) {
+            out.push_back(value.get());
+        }
+    }
+    error::result_t<json::ref_t> try_at(int index) const override {
+        auto it = std::lower_bound(entries.begin(), entries.end(), index,
+                                   [](const auto &entry, int i) {
+                                       return entry.first < (size_t)i;
+                                   });
+        if (index >= 0 && it != entries.end() && it->first == (size_t)index) {
+            return it->second.get();
+        }
+        return std::unexpected(
+                error::error_t{error::Code::INDEX_OUT_OF_RANGE});
+    }
+    using Node::try_at;
+
+  private:
+    size_t count;
+    entries_t entries;
+};
+
+// The ints of a folded list, or of one field of its dict elements: their
+// minimum and maximum, or why there is no column.
+struct fold_t {
+    // {min, max}, empty while no value was added.
+    json::tree::column_t bounds;
+    // Set once a value is not an int.
+    bool ints = true;
+    // The type of the first value that is not an int.
+    json::tree::Type other = json::tree::Type::INT;
+
+    void add(json::tree::Type type, json::ref_t value) {
+        if (type != json::tree::Type::INT || !value) {
+            if (ints) {
+                ints = false;
+                other = type;
+            }
+            return;
+        }
+        int64_t v = value->to_int();
+        if (bounds.empty()) {
+            bounds = {v, v};
+        } else {
+            bounds[0] = std::min(bounds[0], v);
+            bounds[1] = std::max(bounds[1], v);
+        }
+    }
+};
+
+// A list reduced to what aggregates read: its size, and as columns the
+// minimum and maximum of its ints and of each aggregated field of its dict
+// elements, which give the same min and max as the full columns.
+class FoldedList : public json::tree::Node {
+  public:
+    FoldedList(size_t count, fold_t &&values,
+               std::unordered_map<std::string, fold_t> &&fields)
+        : Node(json::tree::Type::LIST), count(count),
+          values(std::move(values)), fields(std::move(fields)) {
+        // What collect() hands to aggregates when the column is missing:
+        // the first value that is not an int, for its error.
+        switch (this->values.other) {
+        case json::tree::Type::STRING:
+            first = std::make_unique<json::tree::StringNode>("");
+            break;
+        case json::tree::Type::DICT:
+            first = std::make_unique<json::tree::DictNode>(
+                    json::tree::dict_t{});
+            break;
+        case json::tree::Type::LIST:
+            first = std::make_unique<json::tree::ListNode>(
+                    json::tree::list_t{});
+            break;
+        default:
+            break;
+        }
+    }
+    std::string to_string() const override {
+        throw std::logic_error("JSON: Folded lists can not be printed");
+    }
+    int64_t to_int() const override {
+        throw std::runtime_error("JSON: List can not be converted to int");
+    }
+    size_t size() const override { return count; }
+    void collect(std::vector<json::ref_t> &out) const override {
+        if (first) {
+            out.push_back(first.get());
+        }
+    }
+    const json::tree::column_t *column() const override {
+        return values.ints ? &values.bounds : nullptr;
+    }
+    const json::tree::column_t *column(const std::string &key) const override {
+        auto it = fields.find(key);
+        return it != fields.end() && it->second.ints ? &it->second.bounds
+                                                     : nullptr;
+    }
+
+  private:
+    size_t count;
+    fold_t values;
+    std::unordered_map<std::string, fold_t> fields;
+    json::json_t first;
+};
+
+// What happens to the next value: skipped, followed through the automaton,
+// kept whole, or, for lists, folded into a FoldedList.
+enum class Mode { SKIP, MATCH, BUILD, FOLD };
+
+struct target_t {
+    Mode mode;
+    size_t state;
+};
+
+// Reads the document with the grammar of json::parse, keeping only the
+// values the automaton leads to. Like json_parser it keeps open containers
+// on a heap stack.
+class scanner : public parser::Parser {
+  public:
+    scanner(std::istream *is, const automaton_t &automaton,
+            const json::options_t &options)
+        : Parser(is), automaton(automaton), states(automaton.states),
+          options(options) {}
+
+    json::json_t run() {
+        target_t target = follow(0);
+        json::json_t result;
+        while (true) {
+            if (target.mode == Mode::SKIP) {
+                skip();
+                result = nullptr;
+            } else if (next() == '{' || next() == '[') {
+                bool dict = next() == '{';
+                open(dict ? json::tree::Type::DICT : json::tree::Type::LIST,
+                     target);
+                if (next() != (dict ? '}' : ']')) {
+                    target = dict ? key() : element();
+                    continue;
+                }
+                result = close();
+            } else {
+                result = value();
+            }
+
+            // Hand the finished value to the enclosing containers, closing
+            // every one that ends here.
+            while (!stack.empty()) {
+                frame_t &top = stack.back();
+                add(top, std::move(result));
+                ++top.count;
+                if (next() == ',') {
+                    advance();
+                    target = top.type == json::tree::Type::DICT ? key()
+                                                                 : element();
+                    break;
+                }
+                result = close();
+            }
+            if (stack.empty()) {
+                if (!eof()) {
+                    fail(error::Code::JSON_EOF_EXPECTED);
+                }
+                return result;
+            }
+        }
+    }
+
+  private:
+    struct frame_t {
+        json::tree::Type type;
+        Mode mode;
+        size_t state;
+        // Lists reached only through constant indices keep just those.
+        bool sparse = false;
+        // Folded lists keep no elements, see FoldedList.
+        bool fold = false;
+        fold_t values;
+        std::unordered_map<std::string, fold_t> fields;
+        // The type of the element being read, for folding.
+        json::tree::Type child = json::tree::Type::INT;
+        // Values read so far, kept or not.
+        size_t count = 0;
+        json::tree::dict_t dict;
+        json::tree::list_t list;
+        SparseList::entries_t entries;
+        std::string key;
+    };
+
+    // Decides how the next value, reached at `state`, is read. Aggregated
+    // values are kept whole, except lists that fold.
+    target_t follow(size_t state) {
+        if (states[state].terminal) {
+            return {Mode::BUILD, state};
+        }
+        if (next() == '[' && automaton.foldable(state)) {
+            return {Mode::FOLD, state};
+        }
+        if (states[state].fold) {
+            return {Mode::BUILD, state};
+        }
+        return {Mode::MATCH, state};
+    }
+
+    static json::tree::Type type(char c) {
+        switch (c) {
+        case '{':
+            return json::tree::Type::DICT;
+        case '[':
+            return json::tree::Type::LIST;
+        case '"':
+            return json::tree::Type::STRING;
+        default:
+            return json::tree::Type::INT;
+        }
+    }
+
+    // Reads a key and decides what to do with its value.
+    target_t key() {
+        frame_t &top = stack.back();
+        top.key = string();
+        expect(':');
+        if (top.mode == Mode::BUILD) {
+            return {Mode::BUILD, none};
+        }
+        const auto &keys = states[top.state].keys;
+        auto it = keys.find(top.key);
+        if (it == keys.end()) {
+            return {Mode::SKIP, none};
+        }
+        return follow(it->second);
+    }
+
+    // Decides what to do with the next list element. Keys on a list's state
+    // apply to its elements, as in aggregates like min(a.b.c).
+    target_t element() {
+        frame_t &top = stack.back();
+        if (top.mode == Mode::BUILD) {
+            return {Mode::BUILD, none};
+        }
+        if (top.fold) {
+            // Ints are read and folded, dicts matched for their aggregated
+            // fields, anything else only skipped.
+            top.child = type(next());
+            if (top.child == json::tree::Type::INT) {
+                return {Mode::BUILD, none};
+            }
+            if (top.child == json::tree::Type::DICT && !top.fields.empty()) {
+                return {Mode::MATCH, top.state};
+            }
+            return {Mode::SKIP, none};
+        }
+        const state_t &state = states[top.state];
+        size_t targets = 0, to = none;
+        auto it = state.indices.find(static_cast<int>(top.count));
+        if (it != state.indices.end()) {
+            ++targets;
+            to = it->second;
+        }
+        if (state.any != none) {
+            ++targets;
+            to = state.any;
+        }
+        if (!state.keys.empty()) {
+            ++targets;
+            to = top.state;
+        }
+        if (targets == 0) {
+            return {Mode::SKIP, none};
+        }
+        // Several paths continue here; keeping the element whole serves all.
+        if (targets > 1) {
+            return {Mode::BUILD, none};
+        }
+        return follow(to);
+    }
+
+    void open(json::tree::Type type, target_t target) {
+        advance();
+        if (stack.size() >= options.max_depth) {
+            fail(error::Code::MAX_DEPTH);
+        }
+        frame_t frame{type, target.mode, target.state};
+        if (type == json::tree::Type::LIST && target.mode == Mode::MATCH) {
+            const state_t &state = states[target.state];
+            frame.sparse = state.any == none && state.keys.empty();
+        }
+        if (target.mode == Mode::FOLD) {
+            frame.mode = Mode::MATCH;
+            frame.fold = true;
+            for (const auto &[key, to] : states[target.state].keys) {
+                frame.fields.emplace(key, fold_t{});
+            }
+        }
+        stack.push_back(std::move(frame));
+        stats::depth(stack.size());
+    }
+
+    void add(frame_t &top, json::json_t &&value) {
+        if (top.fold) {
+            top.values.add(top.child, value.get());
+            for (auto &[key, field] : top.fields) {
+                auto found = value && value->type == json::tree::Type::DICT
+                                     ? value->try_at(key)
+                                     : nullptr;
+                field.add(found ? (*found)->type : json::tree::Type::DICT,
+                          found ? *found : nullptr);
+            }
+            return;
+        }
+        if (!value) {
+            return;
+        }
+        if (top.type == json::tree::Type::DICT) {
+            top.dict.emplace_back(std::move(top.key), std::move(value));
+        } else if (top.sparse) {
+            top.entries.emplace_back(top.count, std::move(value));
+        } else {
+            top.list.push_back(std::move(value));
+        }
+    }
+
+    json::json_t close() {
+        frame_t &top = stack.back();
+        json::json_t result;
+        if (top.type == json::tree::Type::DICT) {
+            expect('}');
+            stats::node(json::tree::Type::DICT);
+            result = std::make_unique<json::tree::DictNode>(
+                    std::move(top.dict));
+        } else {
+            expect(']');
+            stats::node(json::tree::Type::LIST);
+            if (top.fold) {
+                result = std::make_unique<FoldedList>(
+                        top.count, std::move(top.values),
+                        std::move(top.fields));
+            } else if (top.sparse) {
+                result = std::make_unique<SparseList>(top.count,
+                                                      std::move(top.entries));
+            } else {
+                result = std::make_unique<json::tree::ListNode>(
+                        std::move(top.list));
+            }
+        }
+        stack.pop_back();
+        return result;
+    }
+
+    json::json_t value() {
+        if (next() == '"') {
+            stats::node(json::tree::Type::STRING);
+            return std::make_unique<json::tree::StringNode>(string());
+        }
+        if (std::isdigit(next())) {
+            stats::node(json::tree::Type::INT);
+            return std::make_unique<json::tree::IntNode>(number());
+        }
+        fail(error::Code::UNEXPECTED_CHAR);
+        return nullptr;
+    }
+
+    std::string string() {
+        std::string result;
+        expect('"');
+        while (next() != '"') {
+            result.push_back(next());
+            advance();
+        }
+        expect('"');
+        return result;
+    }
+
+    int64_t number() {
+        int64_t result = 0;
+        while (std::isdigit(next())) {
+            if (!json::push_digit(result, next())) {
+                fail(error::Code::INTEGER_RANGE);
+                return 0;
+            }
+            advance();
+        }
+        return result;
+    }
+
+    // Skips a value without decoding it: strings and numbers are read past,
+    // containers by matching brackets. Their contents are not checked
+    // further, e.g. for missing commas or colons.
+    void skip() {
+        if (next() == '"') {
+            skip_string();
+            return;
+        }
+        if (std::isdigit(next())) {
+            while (std::isdigit(next())) {
+                advance();
+            }
+            return;
+        }
+        if (next() != '{' && next() != '[') {
+            fail(error::Code::UNEXPECTED_CHAR);
+        }
+        skipped.clear();
+        do {
+            char c = next();
+            if (c == '"') {
+                skip_string();
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                skipped.push_back(c == '{' ? '}' : ']');
+                if (stack.size() + skipped.size() > options.max_depth) {
+                    fail(error::Code::MAX_DEPTH);
+                }
+            } else if (c == '}' || c == ']') {
+                if (c != skipped.back()) {
+                    fail(error::Code::EXPECTED_CHAR, skipped.back());
+                }
+                skipped.pop_back();
+            }
+            advance();
+        } while (!skipped.empty());
+    }
+
+    void skip_string() {
+        expect('"');
+        while (next() != '"') {
+            advance();
+        }
+        advance();
+    }
+
+    const automaton_t &automaton;
+    const std::vector<state_t> &states;
+    const json::options_t &options;
+    std::vector<frame_t> stack;
+    // Openers of the containers skip() is in.
+    std::vector<char> skipped;
+};
+
+} // namespace
+
+std::vector<result_t> evaluate(std::istream &is,
+                               const std::vector<expr::tree::Node *> &exprs,
+                               const json::options_t &options) {
+    automaton_t automaton;
+    for (auto expr : exprs) {
+        automaton.add(*expr);
+    }
+    json::json_t root;
+    {
+        stats::timer timer(stats::Phase::PARSE);
+        scanner scan(&is, automaton, options);
+        root = scan.run();
+        stats::consumed(scan.consumed());
+    }
+
+    stats::timer timer(stats::Phase::EVAL);
+    std::vector<result_t> results;
+    results.reserve(exprs.size());
+    for (auto expr : exprs) {
+        try {
+            results.push_back({true, batch::evaluate(*expr, root.get())});
+        } catch (const std::exception &e) {
+            results.push_back({false, e.what()});
+        }
+    }
+    return results;
+}
+
+} // namespace stream
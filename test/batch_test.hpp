@@ -0,0 +1,102 @@
+#ifndef BATCH_TEST_H
+#define BATCH_TEST_H
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "test.hpp"
+#include <batch.hpp>
+#include <expr_parser.hpp>
+
+namespace batch_test {
+
+// Empty files are handed to the workers without a read; their descriptors
+// must still be closed, or a low descriptor limit fails the later files.
+static inline bool test_empty_files() {
+    std::cerr << "Testing test_empty_files" << std::endl;
+    auto dir = std::filesystem::temp_directory_path() / "batch_test_empty";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    std::vector<std::string> files;
+    for (int i = 0; i < 400; ++i) {
+        files.push_back((dir / (std::to_string(i) + ".json")).string());
+        std::ofstream(files.back());
+    }
+    files.push_back((dir / "z.json").string());
+    std::ofstream(files.back()) << R"({"a": 1})";
+
+    std::istringstream expr_stream("a");
+    auto expr = expr::parse(expr_stream);
+    batch::options_t options;
+    options.threads = 2;
+
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlimit low = limit;
+    low.rlim_cur = std::min<rlim_t>(limit.rlim_cur, 64);
+    setrlimit(RLIMIT_NOFILE, &low);
+    size_t failed_open = 0;
+    std::string last;
+    batch::run(files, *expr, options, [&](const batch::result_t &r) {
+        if (r.value == "Failed to open file") {
+            ++failed_open;
+        }
+        if (r.file == files.back()) {
+            last = r.ok ? r.value : "Error: " + r.value;
+        }
+    });
+    setrlimit(RLIMIT_NOFILE, &limit);
+    std::filesystem::remove_all(dir);
+    return failed_open == 0 && last == "1";
+}
+
+// Files shorter than their size when opened, like sysfs files that report
+// a page, fail instead of being evaluated truncated, and give back all the
+// budget they took so that later files are still read.
+static inline bool test_short_read() {
+    std::cerr << "Testing test_short_read" << std::endl;
+    const std::string sysfs = "/sys/devices/system/cpu/online";
+    if (!std::filesystem::exists(sysfs)) {
+        return true;
+    }
+    auto dir = std::filesystem::temp_directory_path() / "batch_test_short";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    std::vector<std::string> files(8, sysfs);
+    files.push_back((dir / "z.json").string());
+    std::ofstream(files.back()) << R"({"a": 1})";
+
+    std::istringstream expr_stream("a");
+    auto expr = expr::parse(expr_stream);
+    batch::options_t options;
+    options.threads = 1;
+    options.max_in_flight = 6000;
+    size_t changed = 0;
+    std::string last;
+    batch::run(files, *expr, options, [&](const batch::result_t &r) {
+        if (r.file == sysfs && r.value == "File changed while reading") {
+            ++changed;
+        }
+        if (r.file == files.back()) {
+            last = r.ok ? r.value : "Error: " + r.value;
+        }
+    });
+    std::filesystem::remove_all(dir);
+    return changed == 8 && last == "1";
+}
+
+inline void test_all() {
+    std::cerr << "Testing batch" << std::endl;
+    test_assert(test_empty_files());
+    test_assert(test_short_read());
+    std::cerr << "All batch tests passed\n" << std::endl;
+}
+} // namespace batch_test
+
+#endif
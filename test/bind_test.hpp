@@ -0,0 +1,141 @@
+#ifndef BIND_TEST_H
+#define BIND_TEST_H
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.hpp"
+#include <json_bind.hpp>
+#include <json_parser.hpp>
+
+namespace bind_test {
+
+struct item {
+    std::string name;
+    int count = 0;
+};
+
+struct order {
+    long id = 0;
+    std::vector<item> items;
+    std::map<std::string, int> totals;
+    item main;
+};
+
+} // namespace bind_test
+
+template <> struct json::bind::fields<bind_test::item> {
+    static constexpr auto value = std::make_tuple(
+            JSON_FIELD(bind_test::item, name), JSON_FIELD(bind_test::item, count));
+};
+
+template <> struct json::bind::fields<bind_test::order> {
+    static constexpr auto value = std::make_tuple(
+            JSON_FIELD(bind_test::order, id), JSON_FIELD(bind_test::order, items),
+            JSON_FIELD(bind_test::order, totals),
+            JSON_FIELD(bind_test::order, main));
+};
+
+namespace bind_test {
+
+template <typename T> static inline bool test_panics(const std::string &json) {
+    std::istringstream json_stream(json);
+    T out;
+    try {
+        json::parse(json_stream, out);
+    } catch (const std::exception &e) {
+        return true;
+    }
+    std::cerr << "\tTest did not panic: " << json << std::endl;
+    return false;
+}
+
+inline bool test_ok() {
+    std::cerr << "Testing test_ok" << std::endl;
+    std::istringstream json(R"({"id": 4000000000, "items": [{"name": "a",
+        "count": 2}, {"count": 3, "name": "b"}], "totals": {"x": 1, "y": 2},
+        "main": {"name": "c"}})");
+    try {
+        order o;
+        json::parse(json, o);
+        test_assert(o.id == 4000000000);
+        test_assert(o.items.size() == 2);
+        test_assert(o.items[0].name == "a" && o.items[0].count == 2);
+        test_assert(o.items[1].name == "b" && o.items[1].count == 3);
+        test_assert(o.totals.size() == 2 && o.totals["y"] == 2);
+        test_assert(o.main.name == "c" && o.main.count == 0);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool test_unknown_keys() {
+    std::cerr << "Testing test_unknown_keys" << std::endl;
+    std::istringstream json(R"({"extra": {"a": [1, {"b": "]"}], "c": 2},
+        "name": "n", "more": [[], {}], "count": 7, "last": 1})");
+    try {
+        item i;
+        json::parse(json, i);
+        test_assert(i.name == "n" && i.count == 7);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool test_containers() {
+    std::cerr << "Testing test_containers" << std::endl;
+    std::istringstream json(R"([[1, 2], [], [3]])");
+    try {
+        std::vector<std::vector<int>> v;
+        json::parse(json, v);
+        test_assert(v.size() == 3 && v[0][1] == 2 && v[1].empty() &&
+                    v[2][0] == 3);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool test_bad() {
+    std::cerr << "Testing test_bad" << std::endl;
+    return test_panics<item>(R"({"name": 1})") &&
+           test_panics<item>(R"({"count": "x"})") &&
+           test_panics<item>(R"({"name": "a", "x": [1, 2})") &&
+           test_panics<order>(R"({"items": {}})") &&
+           test_panics<std::vector<int>>(R"([1, 2] 3)") &&
+           test_panics<item>(R"({"x": [1}, "name": "a"})") &&
+           test_panics<item>(R"({"x": {"y": []]}, "count": 1})");
+}
+
+// Integers must fit the field's type.
+inline bool test_int_range() {
+    std::cerr << "Testing test_int_range" << std::endl;
+    std::istringstream json(R"({"count": 2147483647})");
+    item i;
+    json::parse(json, i);
+    test_assert(i.count == 2147483647);
+    return test_panics<item>(R"({"count": 2147483648})") &&
+           test_panics<order>(R"({"id": 99999999999999999999})") &&
+           test_panics<std::vector<unsigned char>>(R"([255, 256])");
+}
+
+inline void test_all() {
+    std::cerr << "Testing bind" << std::endl;
+    test_assert(test_ok());
+    test_assert(test_unknown_keys());
+    test_assert(test_containers());
+    test_assert(test_int_range());
+    test_assert(test_bad());
+    std::cerr << "All bind tests passed\n" << std::endl;
+}
+} // namespace bind_test
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef EXECUTOR_TEST_H
+#define EXECUTOR_TEST_H
+
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.hpp"
+#include <batch.hpp>
+#include <executor.hpp>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+
+namespace executor_test {
+
+inline std::string example_json =
+        R"({"a": {"b": [{"c": 3}, {"c": 1}, {"c": 7}], "d": [4, 2, 9]}, )"
+        R"("e": {"x": 5, "y": 8}})";
+
+static inline expr::expr_t parse_expr(const std::string &text) {
+    std::istringstream is(text);
+    return expr::parse(is);
+}
+
+// Many submissions of the same expressions on a fresh document, so that
+// workers race to build the list columns.
+static inline bool test_futures() {
+    std::cerr << "Testing test_futures" << std::endl;
+    std::istringstream json_stream(example_json);
+    auto json = json::parse(json_stream);
+    std::vector<std::string> texts = {"min(a.b.c)", "max(a.d) + size(a.b)",
+                                      "max(e)",     "a.b[1]",
+                                      "a.q",        "min(a.b)"};
+    std::vector<expr::expr_t> exprs;
+    for (const auto &text : texts) {
+        exprs.push_back(parse_expr(text));
+    }
+
+    query::Executor executor(json.get(), {.threads = 4});
+    test_assert(executor.threads() == 4);
+    std::vector<std::future<query::result_t>> futures;
+    for (size_t round = 0; round < 50; ++round) {
+        for (const auto &e : exprs) {
+            futures.push_back(executor.submit(*e));
+        }
+    }
+    for (size_t i = 0; i < futures.size(); ++i) {
+        auto result = futures[i].get();
+        size_t j = i % exprs.size();
+        const auto &e = *exprs[j];
+        std::string expected;
+        bool ok = true;
+        try {
+            expected = batch::evaluate(e, json.get());
+        } catch (const std::exception &error) {
+            expected = error.what();
+            ok = false;
+        }
+        if (result.ok != ok || result.value != expected) {
+            std::cerr << "\tResults differ: " << texts[j] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool test_callbacks() {
+    std::cerr << "Testing test_callbacks" << std::endl;
+    std::istringstream json_stream(example_json);
+    auto json = json::parse(json_stream);
+    auto e = parse_expr("min(a.b.c) + max(e)");
+    std::atomic<size_t> calls = 0, wrong = 0;
+    {
+        query::Executor executor(json.get(), {.threads = 3});
+        for (size_t i = 0; i < 100; ++i) {
+            executor.submit(*e, [&](const query::result_t &result) {
+                ++calls;
+                if (!result.ok || result.value != "9") {
+                    ++wrong;
+                }
+            });
+        }
+    }
+    return calls == 100 && wrong == 0;
+}
+
+inline void test_all() {
+    std::cerr << "Testing executor" << std::endl;
+    test_assert(test_futures());
+    test_assert(test_callbacks());
+    std::cerr << "All executor tests passed\n" << std::endl;
+}
+} // namespace executor_test
+
+#endif
@@ -2,9 +2,11 @@
 #define EXPR_TEST_H
 
 #include "test.hpp"
+#include <batch.hpp>
 #include <expr_parser.hpp>
 #include <iostream>
 #include <json_parser.hpp>
+#include <prepared_expr.hpp>
 #include <sstream>
 #include <string>
 
@@ -154,6 +156,94 @@ static inline bool test_single() {
     return test_str(json, expr, R"({"b": [1, 2, 3]})");
 }
 
+static inline bool test_field_aggregate() {
+    std::cerr << "Testing test_field_aggregate" << std::endl;
+    std::string json = R"({"a": { "b": [ {"c": 3}, {"c": 1}, {"c": 7} ]}})";
+    return test_int(json, "min(a.b.c)", 1) && test_int(json, "max(a.b.c)", 7) &&
+           test_int(json, "min(a.b.c) + max(a.b.c)", 8);
+}
+
+static inline bool test_field_aggregate_mixed() {
+    std::cerr << "Testing test_field_aggregate_mixed" << std::endl;
+    std::string json = R"({"a": { "b": [ {"c": 3}, {"c": "x"} ]}})";
+    return test_panic(json, "min(a.b.c)") && test_panic(json, "max(a.b)");
+}
+
+static inline bool test_large_ints() {
+    std::cerr << "Testing test_large_ints" << std::endl;
+    std::string json = R"({"a": [3000000000, 2], "b": {"c": 1000000}})";
+    std::istringstream json_stream(json), expr_stream("max(a) + b.c");
+    auto j = json::parse(json_stream);
+    auto e = expr::parse(expr_stream);
+    test_assert(batch::evaluate(*e, j.get()) == "3001000000");
+    // Literals are 64-bit too, and indices beyond int fail instead of
+    // wrapping around to another element.
+    std::istringstream literal_stream("99999999999999999999");
+    test_assert(expr::try_parse(literal_stream).error().code ==
+                error::Code::INTEGER_RANGE);
+    return test_int(json, "min(a) + max(b)", 1000002) &&
+           test_int(json, "3000000000 - max(a)", 0) &&
+           test_panic(json, "a[4294967296]") &&
+           test_panic(json, "a[a[0] * a[0] * a[0]]");
+}
+
+static inline bool test_try_eval() {
+    std::cerr << "Testing test_try_eval" << std::endl;
+    std::istringstream json_stream(R"({"a": {"b": [3, 1, 7], "c": "x"}})");
+    json::json_t json = json::parse(json_stream);
+    auto eval = [&json](const std::string &str) {
+        std::istringstream expr_stream(str);
+        return expr::parse(expr_stream)->try_eval(json.get());
+    };
+    test_assert(eval("max(a.b) - a.b[1]") == 6);
+    test_assert(eval("a.d").error().code == error::Code::KEY_NOT_FOUND);
+    test_assert(eval("1 + a.b[3]").error().code ==
+                error::Code::INDEX_OUT_OF_RANGE);
+    test_assert(eval("a.c").error().code == error::Code::NOT_INT);
+    test_assert(eval("min(a.c.d)").error().code == error::Code::NO_KEYS);
+    test_assert(eval("avg(a.b)").error().code ==
+                error::Code::UNKNOWN_FUNCTION);
+
+    std::istringstream bad("max(a.b");
+    auto expr = expr::try_parse(bad);
+    test_assert(!expr.has_value());
+    test_assert(expr.error().code == error::Code::UNEXPECTED_EOF);
+    test_assert(expr.error().offset == 7);
+    std::istringstream trailing("a.b)");
+    test_assert(expr::try_parse(trailing).error().code ==
+                error::Code::EXPR_EOF_EXPECTED);
+    return true;
+}
+
+static inline bool test_prepared() {
+    std::cerr << "Testing test_prepared" << std::endl;
+    std::vector<std::string> records = {
+            R"({"id": 1, "a": {"x": 5, "b": [1, 2]}})",
+            R"({"id": 2, "a": {"x": 7, "b": [3, 4]}})",
+            R"({"id": 3, "a": {"x": 9, "b": [5, 6]}})",
+            // Another shape: the keys moved.
+            R"({"a": {"b": [7, 8], "x": 11}, "id": 4})",
+    };
+    std::istringstream expr_stream("a.x + a.b[1] + id");
+    expr::Prepared prepared(expr::parse(expr_stream));
+    std::vector<expr::eval_t> expected = {8, 13, 18, 23};
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::istringstream json_stream(records[i]);
+        json::json_t json = json::parse(json_stream);
+        test_assert(prepared.eval(json.get()) == expected[i]);
+    }
+    // Five dict lookups per record: a, x, a, b and id.
+    auto counters = prepared.counters();
+    test_assert(counters.hits + counters.misses == 20);
+    test_assert(counters.misses == 5 + 5);
+
+    std::istringstream missing_stream(R"({"id": 5, "a": {"b": [1, 2]}})");
+    json::json_t missing = json::parse(missing_stream);
+    test_assert(prepared.try_eval(missing.get()).error().code ==
+                error::Code::KEY_NOT_FOUND);
+    return true;
+}
+
 inline void test_all() {
     std::cerr << "Testing expr" << std::endl;
     test_assert(test_example1());
@@ -172,6 +262,11 @@ inline void test_all() {
     test_assert(test_nested_func2());
     test_assert(test_expr_in_func());
     test_assert(test_single());
+    test_assert(test_field_aggregate());
+    test_assert(test_field_aggregate_mixed());
+    test_assert(test_large_ints());
+    test_assert(test_try_eval());
+    test_assert(test_prepared());
     std::cerr << "All expr tests passed\n" << std::endl;
 }
 } // namespace expr_test
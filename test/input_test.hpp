@@ -0,0 +1,112 @@
+#ifndef INPUT_TEST_H
+#define INPUT_TEST_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "test.hpp"
+#include <input.hpp>
+#include <json_parser.hpp>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace input_test {
+
+inline std::string example_json =
+        R"({"a": { "b": [ 1, 2, { "c": "test" }, [11, 12] ]}})";
+
+#ifdef HAVE_ZLIB
+static inline std::string gzip(const std::string &data) {
+    z_stream z = {};
+    // 15 window bits, +16 for a gzip header.
+    deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                 Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&z, data.size()), '\0');
+    z.next_in = (Bytef *)data.data();
+    z.avail_in = data.size();
+    z.next_out = (Bytef *)out.data();
+    z.avail_out = out.size();
+    deflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+static inline bool test_gzip() {
+    std::cerr << "Testing test_gzip" << std::endl;
+    std::istringstream is(gzip(example_json));
+    try {
+        // Tiny blocks and a short queue exercise the hand-off.
+        io::options_t options;
+        options.block_size = 7;
+        options.queue_depth = 1;
+        auto decompressed = io::decompress(is, options);
+        test_assert(decompressed != nullptr);
+        json::json_t j = json::parse(*decompressed);
+        test_assert(j->at("a")->at("b")->at(3)->to_string() == "[11, 12]");
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static inline bool test_gzip_members() {
+    std::cerr << "Testing test_gzip_members" << std::endl;
+    std::istringstream is(gzip("[1, 2,") + gzip(" 3]"));
+    try {
+        auto decompressed = io::decompress(is);
+        json::json_t j = json::parse(*decompressed);
+        test_assert(j->to_string() == "[1, 2, 3]");
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static inline bool test_gzip_corrupt() {
+    std::cerr << "Testing test_gzip_corrupt" << std::endl;
+    std::string data = gzip(example_json);
+    std::istringstream is(data.substr(0, data.size() / 2));
+    try {
+        auto decompressed = io::decompress(is);
+        json::parse(*decompressed);
+    } catch (const std::exception &e) {
+        return true;
+    }
+    std::cerr << "\tTest did not panic" << std::endl;
+    return false;
+}
+#endif
+
+static inline bool test_plain() {
+    std::cerr << "Testing test_plain" << std::endl;
+    std::istringstream is(example_json);
+    try {
+        test_assert(io::decompress(is) == nullptr);
+        json::json_t j = json::parse(is);
+        test_assert(j->at("a")->at("b")->at(1)->to_int() == 2);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline void test_all() {
+    std::cerr << "Testing input" << std::endl;
+    test_assert(test_plain());
+#ifdef HAVE_ZLIB
+    test_assert(test_gzip());
+    test_assert(test_gzip_members());
+    test_assert(test_gzip_corrupt());
+#endif
+    std::cerr << "All input tests passed\n" << std::endl;
+}
+} // namespace input_test
+
+#endif
@@ -9,10 +9,11 @@
 
 namespace json_test {
 
-static inline bool test_panics(const std::string &json) {
+static inline bool test_panics(const std::string &json,
+                               const json::options_t &options = {}) {
     std::istringstream json_stream(json);
     try {
-        json::json_t j = json::parse(json_stream);
+        json::json_t j = json::parse(json_stream, options);
     } catch (const std::exception &e) {
         return true;
     }
@@ -72,6 +73,219 @@ inline bool test_bad_val() {
     return test_panics(json_str);
 }
 
+inline bool test_deep() {
+    std::cerr << "Testing test_deep" << std::endl;
+    std::string json_str = std::string(1000, '[') + std::string(1000, ']');
+    std::istringstream json(json_str);
+    try {
+        json::json_t j = json::parse(json);
+        test_assert(j->size() == 1);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    std::string too_deep = std::string(100000, '[') + std::string(100000, ']');
+    return test_panics(too_deep);
+}
+
+inline bool test_max_depth() {
+    std::cerr << "Testing test_max_depth" << std::endl;
+    json::options_t options;
+    options.max_depth = 2;
+    std::string json_str = R"({"a": [1, 2]})";
+    std::istringstream json(json_str);
+    try {
+        json::parse(json, options);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    return test_panics(R"({"a": [{"b": 1}]})", options);
+}
+
+inline bool test_max_bytes() {
+    std::cerr << "Testing test_max_bytes" << std::endl;
+    json::options_t options;
+    options.max_bytes = 1024;
+    std::string json_str = R"({"a": [1, 2], "b": "short"})";
+    std::istringstream json(json_str);
+    try {
+        json::parse(json, options);
+    } catch (const std::exception &e) {
+        std::cerr << "\tUnexpected error: " << e.what() << std::endl;
+        return false;
+    }
+    std::string long_str = "[\"" + std::string(4096, 'x') + "\"]";
+    std::string list;
+    for (int i = 0; i < 1000; ++i) {
+        list += i ? ", 1" : "[1";
+    }
+    list += "]";
+    return test_panics(long_str, options) && test_panics(list, options);
+}
+
+inline bool test_try_parse() {
+    std::cerr << "Testing test_try_parse" << std::endl;
+    std::istringstream ok(R"({"a": [1, 2]})");
+    auto j = json::try_parse(ok);
+    test_assert(j.has_value());
+    test_assert((*j)->at("a")->at(1)->to_int() == 2);
+    test_assert(!(*j)->try_at("b").has_value());
+    test_assert((*j)->try_at("b").error().code == error::Code::KEY_NOT_FOUND);
+    test_assert(!(*j)->at("a")->try_at(2).has_value());
+    test_assert(!(*j)->at("a")->try_at("b").has_value());
+
+    std::string bad_str = "{\"a\": 1,\n \"b\": x}";
+    std::istringstream bad(bad_str);
+    auto e = json::try_parse(bad);
+    test_assert(!e.has_value());
+    test_assert(e.error().code == error::Code::UNEXPECTED_CHAR);
+    test_assert(e.error().offset == bad_str.find('x'));
+    auto pos = error::position(bad_str, e.error().offset);
+    test_assert(pos.line == 2 && pos.column == 7);
+
+    std::istringstream eof("[1, 2");
+    test_assert(json::try_parse(eof).error().code ==
+                error::Code::UNEXPECTED_EOF);
+    std::istringstream trailing("[1] 2");
+    test_assert(json::try_parse(trailing).error().code ==
+                error::Code::JSON_EOF_EXPECTED);
+    json::options_t options;
+    options.max_depth = 2;
+    std::istringstream deep("[[[1]]]");
+    test_assert(json::try_parse(deep, options).error().code ==
+                error::Code::MAX_DEPTH);
+    return true;
+}
+
+inline bool test_dict_order() {
+    std::cerr << "Testing test_dict_order" << std::endl;
+    std::istringstream json(R"({"b": 1, "a": 2, "c": 3, "a": 4})");
+    json::json_t j = json::parse(json);
+    test_assert(j->to_string() == R"({"b": 1, "a": 4, "c": 3})");
+    test_assert(j->size() == 3);
+    auto dict = static_cast<const json::tree::DictNode *>(j.get());
+    test_assert(dict->slot("c") == 2);
+    test_assert(dict->slot("d") == json::tree::DictNode::npos);
+    test_assert(dict->at_slot(1, "a")->to_int() == 4);
+    test_assert(dict->at_slot(1, "b") == nullptr);
+    return true;
+}
+
+// Checks json::validate, `offset` is the expected error offset or npos.
+static inline bool test_valid(const std::string &json, size_t offset,
+                              const json::options_t &options = {}) {
+    auto result = json::validate(json, options);
+    size_t actual = result ? std::string::npos : result.error().offset;
+    if (actual != offset) {
+        std::cerr << "\tUnexpected validation result (" << actual
+                  << "): " << json << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool test_validate() {
+    std::cerr << "Testing test_validate" << std::endl;
+    const size_t ok = std::string::npos;
+    test_assert(test_valid(R"({"a": [1, -2.5e+3, "x\n\u00e9", true, null]})",
+                           ok));
+    test_assert(test_valid(" [ {}, [], {\"\": false} ] ", ok));
+    test_assert(test_valid("\"caf\xc3\xa9 \xf0\x9f\x98\x80\"", ok));
+    test_assert(test_valid("0", ok));
+    test_assert(test_valid("", 0));
+    test_assert(test_valid("[1, 2", 5));
+    test_assert(test_valid("[1 2]", 3));
+    test_assert(test_valid("{\"a\" 1}", 5));
+    test_assert(test_valid("{\"a\": 1,}", 8));
+    test_assert(test_valid("[01]", 2));
+    test_assert(test_valid("[1.]", 1));
+    test_assert(test_valid("[-]", 1));
+    test_assert(test_valid("[tru]", 1));
+    test_assert(test_valid("\"a\\x\"", 2));
+    test_assert(test_valid("\"a\\u12g4\"", 2));
+    test_assert(test_valid("\"a\tb\"", 2));
+    test_assert(test_valid("\"\xc0\xaf\"", 1));
+    test_assert(test_valid("\"\xed\xa0\x80\"", 1));
+    test_assert(test_valid("\"abcdefghijklmnop", 17));
+    test_assert(test_valid("[1] x", 4));
+    json::options_t options;
+    options.max_depth = 2;
+    test_assert(test_valid("[[1]]", ok, options));
+    test_assert(test_valid("[[[1]]]", 2, options));
+    std::string deep = std::string(100000, '[') + std::string(100000, ']');
+    options.max_depth = -1;
+    test_assert(!json::validate(deep, options).has_value());
+    std::string nested = std::string(60000, '[') + std::string(60000, ']');
+    test_assert(json::validate(nested, options).has_value());
+    return true;
+}
+
+// Parses `json` with `schema` and checks it against the generic parse.
+static inline bool test_same_shape(const std::string &json,
+                                   const json::schema_t &schema) {
+    json::options_t options;
+    options.schema = &schema;
+    std::istringstream generic_is(json), schema_is(json);
+    auto generic = json::parse(generic_is);
+    auto shaped = json::parse(schema_is, options);
+    if (shaped->to_string() != generic->to_string()) {
+        std::cerr << "\tDifferent parse: " << json << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool test_schema() {
+    std::cerr << "Testing test_schema" << std::endl;
+    std::string record = R"({"k1": 1, "k2": 2, "k3": "x", "k4": 4, "k5": 5, )"
+                         R"("k6": 6, "k7": [7], "k8": {"a": 8}, "k9": 9})";
+    std::istringstream sample_is("[" + record + "]");
+    auto sample = json::parse(sample_is);
+    json::schema_t schema = json::infer(sample.get());
+    test_assert(schema.type == json::tree::Type::LIST && schema.size == 1);
+    test_assert(schema.values[0].keys.size() == 9);
+    test_assert(schema.values[0].index != nullptr);
+
+    test_assert(test_same_shape("[" + record + ", " + record + "]", schema));
+    // Reordered, missing, extra, prefixed and repeated keys.
+    test_assert(test_same_shape(
+            R"([{"k2": 2, "k1": 1, "k3": "y"}, {"k1": 1, "k10": 0}, )"
+            R"({"k": 1, "k1x": 2, "k1": 3, "k1": 4}, [1], 5, {}])",
+            schema));
+    test_assert(test_same_shape(R"({"k1": [1, 2]})", schema));
+
+    json::options_t options;
+    options.schema = &schema;
+    std::istringstream is("[" + record + ", " + record + "]");
+    auto j = json::parse(is, options);
+    test_assert(j->at(1)->at("k9")->to_int() == 9);
+    test_assert(j->at(0)->at("k8")->at("a")->to_int() == 8);
+    test_assert(j->at(1)->slot("k5") == 4);
+    test_assert(!j->at(0)->try_at("k0").has_value());
+
+    // A sample's sizes only guide reservations; a huge one reserves little.
+    json::schema_t huge{json::tree::Type::LIST};
+    huge.size = size_t(1) << 60;
+    return test_same_shape("[1, 2]", huge);
+}
+
+inline bool test_int64() {
+    std::cerr << "Testing test_int64" << std::endl;
+    std::string text = "[3000000000, 9223372036854775807, 0]";
+    std::istringstream is(text);
+    auto j = json::parse(is);
+    test_assert(j->to_string() == text);
+    test_assert(j->at(0)->to_int() == 3000000000);
+    test_assert(j->at(1)->to_int() == INT64_MAX);
+    test_assert((*j->column())[1] == INT64_MAX);
+    std::istringstream overflow("[1, 9223372036854775808]");
+    auto result = json::try_parse(overflow);
+    test_assert(!result && result.error().code == error::Code::INTEGER_RANGE);
+    test_assert(result.error().offset == 22);
+    return test_panics("{\"a\": 99999999999999999999}");
+}
+
 inline void test_all() {
     std::cerr << "Testing json" << std::endl;
     test_assert(test_ok());
@@ -79,6 +293,14 @@ inline void test_all() {
     test_assert(test_bad_str_key());
     test_assert(test_bad_str_val());
     test_assert(test_bad_val());
+    test_assert(test_deep());
+    test_assert(test_max_depth());
+    test_assert(test_max_bytes());
+    test_assert(test_try_parse());
+    test_assert(test_dict_order());
+    test_assert(test_validate());
+    test_assert(test_schema());
+    test_assert(test_int64());
     std::cerr << "All json tests passed\n" << std::endl;
 }
 } // namespace json_test
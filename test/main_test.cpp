@@ -1,9 +1,18 @@
 #include <iostream>
 #include <json_parser.hpp>
 
+#include "batch_test.hpp"
+#include "bind_test.hpp"
+#include "executor_test.hpp"
 #include "expr_test.hpp"
 #include "expr_test_base.hpp"
+#include "input_test.hpp"
 #include "json_test.hpp"
+#include "profile_test.hpp"
+#include "serialize_test.hpp"
+#include "sidecar_test.hpp"
+#include "static_expr_test.hpp"
+#include "stream_test.hpp"
 
 using namespace std;
 
@@ -12,6 +21,15 @@ int main() {
         expr_base::test_all();
         json_test::test_all();
         expr_test::test_all();
+        static_expr_test::test_all();
+        bind_test::test_all();
+        input_test::test_all();
+        batch_test::test_all();
+        sidecar_test::test_all();
+        stream_test::test_all();
+        executor_test::test_all();
+        serialize_test::test_all();
+        profile_test::test_all();
     } catch (const exception &e) {
         return 1;
     }
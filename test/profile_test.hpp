@@ -0,0 +1,113 @@
+#ifndef PROFILE_TEST_H
+#define PROFILE_TEST_H
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <profiled_expr.hpp>
+#include <stats.hpp>
+
+namespace profile_test {
+
+inline std::string example_json =
+        R"({"a": { "b": [ 1, 2, { "c": "te st" }, [11, 12], )"
+        R"([{"d": 4}, {"d": 9}] ], "x": 1}})";
+
+static inline expr::expr_t parse(const std::string &expr) {
+    std::istringstream expr_stream(expr);
+    return expr::parse(expr_stream);
+}
+
+static inline bool test_explain() {
+    std::cerr << "Testing test_explain" << std::endl;
+    std::istringstream json_stream(example_json);
+    json::json_t json = json::parse(json_stream);
+    expr::Profiled profiled(parse("max(a.b[3]) + size(a.b)"));
+    test_assert(profiled.eval(json.get()) == 17);
+    test_assert(profiled.eval(json.get()) == 17);
+
+    auto report = profiled.report();
+    test_assert(report.size() == 6);
+    const char *labels[] = {"+", "max()", "a.b[3]", "3", "size()", "a.b"};
+    size_t depths[] = {0, 1, 2, 3, 1, 2};
+    for (size_t i = 0; i < report.size(); ++i) {
+        test_assert(report[i].label == labels[i]);
+        test_assert(report[i].depth == depths[i]);
+        test_assert(report[i].counters.evals == 2);
+    }
+    if (stats::enabled) {
+        // Three steps and two keys probed for a.b[3], two of each for a.b.
+        test_assert(report[0].counters.lookups == 10);
+        test_assert(report[0].counters.probes == 8);
+        test_assert(report[2].counters.lookups == 6);
+        test_assert(report[5].counters.probes == 4);
+        test_assert(report[3].counters.lookups == 0);
+    }
+    std::ostringstream out;
+    profiled.explain(out);
+    return out.str().find("\n         2") != std::string::npos &&
+           out.str().find("      a.b[3]\n") != std::string::npos;
+}
+
+// Paths keep their results through the wrapper, and computed indices are
+// instrumented too.
+static inline bool test_paths() {
+    std::cerr << "Testing test_paths" << std::endl;
+    std::istringstream json_stream(example_json);
+    json::json_t json = json::parse(json_stream);
+    expr::Profiled profiled(parse("a.b[a.b[1]]"));
+    test_assert(profiled.ret_type() == expr::RetType::JSON);
+    test_assert(profiled.to_string(json.get()) ==
+                parse("a.b[2]")->to_string(json.get()));
+    auto report = profiled.report();
+    test_assert(report.size() == 3);
+    test_assert(report[0].label == "a.b[a.b[1]]");
+    test_assert(report[1].label == "a.b[1]" && report[1].depth == 1);
+    return report[1].counters.evals == 1;
+}
+
+// Sampled counters are scaled up to every evaluation, also when evaluated
+// from several threads.
+static inline bool test_sample() {
+    std::cerr << "Testing test_sample" << std::endl;
+    std::istringstream json_stream(example_json);
+    json::json_t json = json::parse(json_stream);
+    expr::Profiled profiled(parse("a.b[4][1].d - a.x"), 4);
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 100; ++i) {
+                wrong += profiled.eval(json.get()) != 8;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    test_assert(wrong == 0);
+    auto report = profiled.report();
+    test_assert(report[0].counters.evals == 400);
+    if (stats::enabled) {
+        test_assert(report[0].counters.lookups == 400 * 7);
+    }
+    return report[0].counters.ms >= 0;
+}
+
+inline void test_all() {
+    std::cerr << "Testing profile" << std::endl;
+    test_assert(test_explain());
+    test_assert(test_paths());
+    test_assert(test_sample());
+    std::cerr << "All profile tests passed\n" << std::endl;
+}
+} // namespace profile_test
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SERIALIZE_TEST_H
+#define SERIALIZE_TEST_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "test.hpp"
+#include <json_parser.hpp>
+#include <serialize.hpp>
+
+namespace serialize_test {
+
+static inline bool test_format() {
+    std::cerr << "Testing test_format" << std::endl;
+    std::istringstream is(R"({"a": ["x", {"b": "y", "c": []}], "d": {}, )"
+                          R"("e": 120})");
+    auto j = json::parse(is);
+    std::string expected =
+            R"({"a": [x, {"b": "y", "c": []}], "d": {}, "e": 120})";
+    test_assert(j->to_string() == expected);
+    test_assert(json::serialize::estimate(j.get()) == expected.size());
+    test_assert(json::serialize::to_string(j.get(), {4, 0}) == expected);
+    test_assert(json::serialize::to_string(j->at("e"), {4, 0}) == "120");
+    return true;
+}
+
+// Splits a document into many small chunks on several threads, which must
+// give the single threaded text.
+static inline bool test_parallel() {
+    std::cerr << "Testing test_parallel" << std::endl;
+    std::string text = R"({"n": 1, "a": [)";
+    for (int i = 0; i < 500; ++i) {
+        text += i ? ", " : "";
+        text += R"({"k": )" + std::to_string(i * 37) +
+                R"(, "s": "v)" + std::to_string(i) + R"(", "l": [[], [)" +
+                std::to_string(i) + R"(], "w"]})";
+    }
+    text += R"(], "z": {"y": [1, 2, 3]}})";
+    std::istringstream is(text);
+    auto j = json::parse(is);
+    std::string expected = j->to_string();
+    test_assert(json::serialize::estimate(j.get()) == expected.size());
+    for (size_t threads : {2, 3, 8}) {
+        json::serialize::options_t options{threads, 0};
+        if (json::serialize::to_string(j.get(), options) != expected) {
+            return false;
+        }
+        std::ostringstream os;
+        json::serialize::write(os, j->at("a"), options);
+        if (os.str() != j->at("a")->to_string()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void test_all() {
+    std::cerr << "Testing serialize" << std::endl;
+    test_assert(test_format());
+    test_assert(test_parallel());
+    std::cerr << "All serialize tests passed\n" << std::endl;
+}
+} // namespace serialize_test
+
+#endif
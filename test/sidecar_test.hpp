@@ -0,0 +1,142 @@
+#ifndef SIDECAR_TEST_H
+#define SIDECAR_TEST_H
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "test.hpp"
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <prepared_expr.hpp>
+#include <sidecar.hpp>
+
+namespace sidecar_test {
+
+inline std::string example_json =
+        R"({"a": { "b": [ 1, 2, { "c": "te st" }, [11, 12], )"
+        R"([{"d": 4}, {"d": 9}] ], "x": 1, "x": 3}})";
+
+static inline std::string write_file(const std::string &name,
+                                     const std::string &data) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream(path, std::ios::binary) << data;
+    std::filesystem::remove(json::sidecar::index_path(path.string()));
+    return path.string();
+}
+
+static inline void remove_files(const std::string &path) {
+    std::filesystem::remove(path);
+    std::filesystem::remove(json::sidecar::index_path(path));
+}
+
+// Compares an expression on the indexed document with the parsed one.
+static inline bool test_same(json::ref_t indexed, const std::string &expr) {
+    std::istringstream json_stream(example_json), expr_stream(expr);
+    json::json_t json = json::parse(json_stream);
+    expr::expr_t e = expr::parse(expr_stream);
+    bool same = e->ret_type == expr::RetType::INT
+                        ? e->eval(indexed) == e->eval(json.get())
+                        : e->to_string(indexed) == e->to_string(json.get());
+    if (!same) {
+        std::cerr << "\tResults differ: " << expr << std::endl;
+    }
+    return same;
+}
+
+static inline bool test_query() {
+    std::cerr << "Testing test_query" << std::endl;
+    std::string path = write_file("sidecar_test_query.json", example_json);
+    test_assert(json::sidecar::open(path) == nullptr);
+    json::sidecar::build(path);
+    auto doc = json::sidecar::open(path);
+    test_assert(doc != nullptr);
+    json::ref_t root = doc->root();
+    bool ok = test_same(root, "a") && test_same(root, "a.b[2].c") &&
+              test_same(root, "a.b[a.b[1]]") && test_same(root, "a.x") &&
+              test_same(root, "max(a.b[3]) + size(a.b)") &&
+              test_same(root, "min(a.b[4].d)") &&
+              test_same(root, "size(a.b[2].c)");
+    test_assert(!root->try_at("b").has_value());
+    test_assert(!root->at("a")->at("b")->try_at(5).has_value());
+
+    std::istringstream expr_stream("a.b[4][1].d");
+    expr::Prepared prepared(expr::parse(expr_stream));
+    test_assert(prepared.eval(root) == 9 && prepared.eval(root) == 9);
+    test_assert(prepared.counters().hits == 3);
+    remove_files(path);
+    return ok;
+}
+
+static inline bool test_stale() {
+    std::cerr << "Testing test_stale" << std::endl;
+    std::string path = write_file("sidecar_test_stale.json", R"({"a": 1})");
+    test_assert(json::sidecar::load(path)->root()->at("a")->to_int() == 1);
+    test_assert(json::sidecar::open(path) != nullptr);
+    std::ofstream(path, std::ios::binary) << R"({"a": 2})";
+    test_assert(json::sidecar::open(path) == nullptr);
+    test_assert(json::sidecar::load(path)->root()->at("a")->to_int() == 2);
+
+    std::ofstream(path, std::ios::binary) << R"({"a": [1, }")";
+    bool failed = false;
+    try {
+        json::sidecar::build(path);
+    } catch (const std::exception &e) {
+        failed = true;
+    }
+    remove_files(path);
+    return failed;
+}
+
+// Containers larger than the in-memory chunk of the indexer, with a
+// repeated key after the chunk was spilled.
+static inline bool test_large() {
+    std::cerr << "Testing test_large" << std::endl;
+    std::string data = R"({"k0": 0)";
+    for (int i = 1; i < 10000; ++i) {
+        data += ", \"k" + std::to_string(i) + "\": " + std::to_string(i);
+    }
+    data += R"(, "k0": 7, "l": [)";
+    for (int i = 0; i < 10000; ++i) {
+        data += (i ? ", " : "") + std::to_string(i);
+    }
+    data += "]}";
+    std::string path = write_file("sidecar_test_large.json", data);
+    auto doc = json::sidecar::load(path);
+    std::istringstream json_stream(data);
+    json::json_t json = json::parse(json_stream);
+    json::ref_t root = doc->root();
+    bool same = root->to_string() == json->to_string() &&
+                root->at("k0")->to_int() == 7 && root->size() == 10001 &&
+                root->at("l")->at(9999)->to_int() == 9999;
+    remove_files(path);
+    return same;
+}
+
+// Printing walks the index without recursion.
+static inline bool test_deep() {
+    std::cerr << "Testing test_deep" << std::endl;
+    size_t depth = 100000;
+    std::string data = std::string(depth, '[') + "1" + std::string(depth, ']');
+    std::string path = write_file("sidecar_test_deep.json", data);
+    json::options_t options;
+    options.max_depth = depth + 1;
+    auto doc = json::sidecar::load(path, options);
+    bool same = doc->root()->to_string() == data;
+    remove_files(path);
+    return same;
+}
+
+inline void test_all() {
+    std::cerr << "Testing sidecar" << std::endl;
+    test_assert(test_query());
+    test_assert(test_stale());
+    test_assert(test_large());
+    test_assert(test_deep());
+    std::cerr << "All sidecar tests passed\n" << std::endl;
+}
+} // namespace sidecar_test
+
+#endif
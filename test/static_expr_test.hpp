@@ -0,0 +1,86 @@
+#ifndef STATIC_EXPR_TEST_H
+#define STATIC_EXPR_TEST_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "test.hpp"
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <static_expr.hpp>
+
+namespace static_expr_test {
+
+inline std::string example_json =
+        R"({"a": { "b": [ 1, 2, { "c": "test" }, [11, 12], [{"d": 4}, {"d": 9}] ]}})";
+
+// Checks the compiled expression against the runtime parser.
+template <expr::fixed::fixed_string S> static inline bool test() {
+    using compiled = expr::fixed::expression<S>;
+    std::istringstream json_stream(example_json), expr_stream(S.value);
+    try {
+        json::json_t json = json::parse(json_stream);
+        expr::expr_t expr = expr::parse(expr_stream);
+        test_assert(compiled::ret_type == expr->ret_type);
+        if constexpr (compiled::ret_type == expr::RetType::INT) {
+            test_assert(compiled::eval(json.get()) == expr->eval(json.get()));
+        } else {
+            test_assert(compiled::to_string(json.get()) ==
+                        expr->to_string(json.get()));
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "\t" << S.value << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static inline bool test_arithmetic() {
+    std::cerr << "Testing test_arithmetic" << std::endl;
+    return test<"10 + (-2 + 4*3)*(12 - 10)">() && test<" 1 + 2 *  \n  3 ">() &&
+           test<"7 / 2 - -1">() && test<"3000000000 * a.b[1]">();
+}
+
+static inline bool test_paths() {
+    std::cerr << "Testing test_paths" << std::endl;
+    return test<"a.b[1]">() && test<"a.b[2].c">() && test<"a.b">() &&
+           test<"a.b[a.b[1]].c">() && test<"a.b[3][1] * 2">();
+}
+
+static inline bool test_functions() {
+    std::cerr << "Testing test_functions" << std::endl;
+    return test<"max(a.b[0], 10, a.b[1], 15)">() && test<"min(a.b[3])">() &&
+           test<"size(a)">() && test<"size(a.b[a.b[1]].c)">() &&
+           test<"size(max(1, 2), a.b)">() && test<"min(a.b[4].d)">() &&
+           test<"max(a.b[4].d) + min(min(a.b[0], a.b[1]), 3)">();
+}
+
+static inline bool test_panic() {
+    std::cerr << "Testing test_panic" << std::endl;
+    std::istringstream json_stream(example_json);
+    auto json = json::parse(json_stream);
+    try {
+        expr::fixed::expression<"a.b[2].x">::to_string(json.get());
+        return false;
+    } catch (const std::exception &e) {
+    }
+    try {
+        expr::fixed::expression<"a.b[4294967296]">::to_string(json.get());
+        return false;
+    } catch (const std::exception &e) {
+        return std::string(e.what()) == "JSON: List index out of range";
+    }
+}
+
+inline void test_all() {
+    std::cerr << "Testing static_expr" << std::endl;
+    test_assert(test_arithmetic());
+    test_assert(test_paths());
+    test_assert(test_functions());
+    test_assert(test_panic());
+    std::cerr << "All static_expr tests passed\n" << std::endl;
+}
+} // namespace static_expr_test
+
+#endif
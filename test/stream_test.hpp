@@ -0,0 +1,124 @@
+#ifndef STREAM_TEST_H
+#define STREAM_TEST_H
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.hpp"
+#include <batch.hpp>
+#include <expr_parser.hpp>
+#include <json_parser.hpp>
+#include <stream.hpp>
+
+namespace stream_test {
+
+inline std::string example_json =
+        R"({"s": "{[ x]", "a": { "b": [ 1, 2, { "c": "te st" }, [11, 12], )"
+        R"([{"d": 4, "e": 0}, {"d": 9}] ], "x": 1, "x": 3, )"
+        R"("y": [[1], {"z": [5]}]}, "n": [7, 8, 9], "e": []})";
+
+// Streams all expressions at once and compares each result with the one
+// from the parsed document.
+static inline bool test_same(const std::vector<std::string> &exprs) {
+    std::istringstream json_stream(example_json);
+    json::json_t json = json::parse(json_stream);
+
+    std::vector<expr::expr_t> parsed;
+    std::vector<expr::tree::Node *> nodes;
+    for (const auto &e : exprs) {
+        std::istringstream expr_stream(e);
+        parsed.push_back(expr::parse(expr_stream));
+        nodes.push_back(parsed.back().get());
+    }
+    std::istringstream stream(example_json);
+    auto results = stream::evaluate(stream, nodes);
+    test_assert(results.size() == exprs.size());
+
+    bool same = true;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        std::string expected;
+        bool ok = true;
+        try {
+            expected = batch::evaluate(*parsed[i], json.get());
+        } catch (const std::exception &e) {
+            expected = e.what();
+            ok = false;
+        }
+        if (results[i].ok != ok || results[i].value != expected) {
+            std::cerr << "\tResults differ: " << exprs[i] << std::endl;
+            same = false;
+        }
+    }
+    return same;
+}
+
+static inline bool test_paths() {
+    std::cerr << "Testing test_paths" << std::endl;
+    return test_same({"a.b[2].c", "a.x", "n[1]", "a.b[3]", "size(a.b[2].c)"}) &&
+           test_same({"s", "a.y[1].z[0] + n[2]"});
+}
+
+static inline bool test_projection() {
+    std::cerr << "Testing test_projection" << std::endl;
+    return test_same({"min(a.b[4].d)", "max(a.b[4].d)", "a.b[4][0].e"}) &&
+           test_same({"a.b[a.b[1]]", "a.b[a.b[0]][1]", "n[a.x - 3]"});
+}
+
+// Lists only aggregated over are folded while read, with the same results
+// and errors as the full lists.
+static inline bool test_fold() {
+    std::cerr << "Testing test_fold" << std::endl;
+    return test_same({"max(n)", "min(n)", "size(n)", "max(e)", "size(e)"}) &&
+           test_same({"size(a.b) + max(n)", "max(a.b)", "max(a.b.c)",
+                      "max(a.b[4].d)", "min(a.b[4].e)", "size(a.b[4].e)"}) &&
+           test_same({"max(a.y)", "min(a.y[1].z)", "max(a.y.z)", "n[0]",
+                      "max(n) - min(n)"}) &&
+           test_same({"max(a.b[4].d) + size(a.b[4])", "a.b[4][1]"});
+}
+
+// Brackets of skipped values must match, as json::parse requires.
+static inline bool test_mismatched() {
+    std::istringstream expr_stream("a");
+    auto e = expr::parse(expr_stream);
+    size_t failed = 0;
+    for (const char *json : {R"({"a": 1, "b": [1}})", R"({"b": {]], "a": 1})",
+                             R"({"b": [{"c": [1]]}], "a": 1})"}) {
+        std::istringstream json_stream(json);
+        try {
+            stream::evaluate(json_stream, {e.get()});
+        } catch (const std::exception &e) {
+            ++failed;
+        }
+    }
+    return failed == 3;
+}
+
+static inline bool test_errors() {
+    std::cerr << "Testing test_errors" << std::endl;
+    bool ok = test_same({"a.q", "n[3]", "a.b[2].c + 1", "a", "min(n) * 2"});
+
+    std::istringstream json_stream(R"({"a": 1, "b": [1, }")"), expr_stream("a");
+    auto e = expr::parse(expr_stream);
+    bool failed = false;
+    try {
+        stream::evaluate(json_stream, {e.get()});
+    } catch (const std::exception &e) {
+        failed = true;
+    }
+    return ok && failed && test_mismatched();
+}
+
+inline void test_all() {
+    std::cerr << "Testing stream" << std::endl;
+    test_assert(test_paths());
+    test_assert(test_projection());
+    test_assert(test_fold());
+    test_assert(test_errors());
+    std::cerr << "All stream tests passed\n" << std::endl;
+}
+} // namespace stream_test
+
+#endif